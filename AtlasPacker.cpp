@@ -0,0 +1,82 @@
+#include "AtlasPacker.hpp"
+#include <algorithm>
+#include <numeric>
+
+AtlasPacker::AtlasPacker(unsigned int pageWidth, unsigned int pageHeight, unsigned int padding, unsigned int maxSide)
+    : pageWidth(pageWidth), pageHeight(pageHeight), padding(padding),
+      maxSide(maxSide > 0 ? maxSide : std::max(pageWidth, pageHeight))
+{
+}
+
+std::vector<AtlasPacker::Placement> AtlasPacker::pack(const std::vector<sf::Vector2u>& sizes)
+{
+    std::vector <Placement> result(sizes.size());
+    std::vector <unsigned int> order(sizes.size());
+
+    shelves.clear();
+    pageSizes.clear();
+    openPage = -1;
+
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sizes](unsigned int a, unsigned int b) {
+        return sizes[a].y > sizes[b].y;
+    });
+
+    for ( unsigned int index : order )
+    {
+        unsigned int width  = sizes[index].x + padding;
+        unsigned int height = sizes[index].y + padding;
+
+        if ( width > pageWidth || height > pageHeight )
+        {
+            // Nothing else goes to the page, so it is only as big as the rectangle.
+            if ( sizes[index].x <= maxSide && sizes[index].y <= maxSide )
+            {
+                result[index].page = pageSizes.size();
+                pageSizes.push_back(sizes[index]);
+            }
+            continue;
+        }
+
+        Shelf *target = nullptr;
+        for ( auto& shelf : shelves )
+        {
+            if ( height <= shelf.height && shelf.usedWidth + width <= pageWidth )
+            {
+                target = &shelf;
+                break;
+            }
+        }
+
+        if ( !target )
+        {
+            // New shelf below the last one on the last page, or a new page.
+            unsigned int y = 0;
+            int page = openPage;
+
+            if ( page >= 0 && pageSizes[page].y + height <= pageHeight )
+                y = pageSizes[page].y;
+            else
+            {
+                page = pageSizes.size();
+                openPage = page;
+                pageSizes.push_back({0, 0});
+            }
+
+            shelves.push_back({page, y, height, 0});
+            target = &shelves.back();
+        }
+
+        result[index].page = target->page;
+        result[index].x = target->usedWidth;
+        result[index].y = target->y;
+
+        target->usedWidth += width;
+
+        sf::Vector2u& pageSize = pageSizes[target->page];
+        pageSize.x = std::max(pageSize.x, target->usedWidth);
+        pageSize.y = std::max(pageSize.y, target->y + target->height);
+    }
+
+    return result;
+}
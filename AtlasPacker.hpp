@@ -0,0 +1,52 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <vector>
+
+/*
+    Shelf packer for texture atlas pages.
+
+    Rectangles are placed tallest first, left to right on horizontal shelves.
+    A rectangle goes to the first shelf it fits on, otherwise a new shelf is
+    opened below the last one, otherwise a new page is started.
+
+    A rectangle bigger than a page gets a page of its own, as big as the
+    rectangle, if it is at most maxSide on both sides. Bigger ones are not
+    placed, their page is -1.
+ */
+
+class AtlasPacker
+{
+public:
+    struct Placement
+    {
+        int page = -1;
+        unsigned int x = 0, y = 0;
+    };
+
+    // maxSide 0 is the bigger page side.
+    AtlasPacker(unsigned int pageWidth, unsigned int pageHeight, unsigned int padding = 1, unsigned int maxSide = 0);
+
+    // Returns placement for every size, in the same order.
+    std::vector<Placement> pack(const std::vector<sf::Vector2u>& sizes);
+
+    // Used area of every page after pack().
+    const std::vector<sf::Vector2u>& getPageSizes() const { return pageSizes; }
+
+private:
+    struct Shelf
+    {
+        int page;
+        unsigned int y;
+        unsigned int height;
+        unsigned int usedWidth;
+    };
+
+    unsigned int pageWidth;
+    unsigned int pageHeight;
+    unsigned int padding;
+    unsigned int maxSide;
+
+    std::vector <Shelf> shelves;
+    int openPage = -1;                  // Last page new shelves can go to
+    std::vector <sf::Vector2u> pageSizes;
+};
@@ -0,0 +1,154 @@
+#include "AtomicWrite.hpp"
+#include <system_error>
+
+#ifdef linux
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+namespace fs = std::filesystem;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <experimental/filesystem>
+#include <io.h>
+namespace fs = std::experimental::filesystem;
+#endif
+
+bool writeFileAtomic(const std::string& filename, const char *data, size_t size, bool keepBackup)
+{
+    AtomicFileWriter writer;
+
+    if ( !writer.open(filename) || !writer.write(data, size) )
+        return false;
+
+    return writer.commit(keepBackup);
+}
+
+bool AtomicFileWriter::open(const std::string& filename)
+{
+    cancel();
+
+    this->filename = filename;
+    failed = false;
+
+#ifdef linux
+    fd = ::open((filename + ".tmp").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    return fd != -1;
+#else
+    file = std::fopen((filename + ".tmp").c_str(), "wb");
+    return file != nullptr;
+#endif
+}
+
+bool AtomicFileWriter::write(const void *data, size_t size)
+{
+    const char *bytes = (const char*)data;
+
+#ifdef linux
+    if ( fd == -1 || failed )
+        return false;
+
+    size_t written = 0;
+    while ( written < size )
+    {
+        ssize_t result = ::write(fd, bytes + written, size - written);
+        if ( result <= 0 )
+        {
+            failed = true;
+            return false;
+        }
+        written += result;
+    }
+#else
+    if ( file == nullptr || failed )
+        return false;
+
+    if ( size > 0 && std::fwrite(bytes, 1, size, file) != size )
+        failed = true;
+#endif
+
+    return !failed;
+}
+
+bool AtomicFileWriter::commit(bool keepBackup)
+{
+    std::string temporary = filename + ".tmp";
+    std::error_code error;
+
+#ifdef linux
+    if ( fd == -1 )
+        return false;
+
+    bool flushed = !failed && fsync(fd) == 0;
+    flushed = ::close(fd) == 0 && flushed;
+    fd = -1;
+#else
+    if ( file == nullptr )
+        return false;
+
+    bool flushed = !failed && std::fflush(file) == 0;
+#if defined(_WIN32) || defined(_WIN64)
+    // fflush only hands the data to the system, _commit writes it to the disk like fsync.
+    flushed = flushed && _commit(_fileno(file)) == 0;
+#endif
+    flushed = std::fclose(file) == 0 && flushed;
+    file = nullptr;
+#endif
+
+    if ( !flushed )
+    {
+        fs::remove(temporary, error);
+        return false;
+    }
+
+    if ( keepBackup && fs::exists(filename, error) )
+    {
+        std::string backup = filename + ".bak";
+        fs::remove(backup, error);
+
+        // Link keeps the old file in place, so filename is never missing.
+        fs::create_hard_link(filename, backup, error);
+        if ( error )
+            fs::rename(filename, backup, error);
+    }
+
+    fs::rename(temporary, filename, error);
+    if ( error )
+    {
+        fs::remove(temporary, error);
+        return false;
+    }
+
+#ifdef linux
+    // Make the rename itself durable.
+    fs::path directory = fs::absolute(filename, error).parent_path();
+    int directoryFd = ::open(directory.c_str(), O_RDONLY);
+    if ( directoryFd != -1 )
+    {
+        fsync(directoryFd);
+        ::close(directoryFd);
+    }
+#endif
+
+    return true;
+}
+
+void AtomicFileWriter::cancel()
+{
+#ifdef linux
+    if ( fd == -1 )
+        return;
+
+    ::close(fd);
+    fd = -1;
+#else
+    if ( file == nullptr )
+        return;
+
+    std::fclose(file);
+    file = nullptr;
+#endif
+
+    std::error_code error;
+    fs::remove(filename + ".tmp", error);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <string>
+#include <cstdio>
+#include <cstddef>
+
+/*
+    Writes data to filename so that filename always has either the old or
+    the new contents, never a half written file.
+
+    The data goes to filename.tmp and is flushed to disk, then the
+    temporary file is renamed over filename. With keepBackup the old file
+    stays as filename.bak (hard link, or rename when links are not
+    supported).
+ */
+
+bool writeFileAtomic(const std::string& filename, const char *data, size_t size, bool keepBackup = false);
+
+// Same as writeFileAtomic, but the data is written in parts. Nothing
+// happens to filename before commit, the temporary file is removed when
+// the writer is destroyed without one.
+class AtomicFileWriter
+{
+public:
+    AtomicFileWriter() {}
+    AtomicFileWriter(const AtomicFileWriter&) = delete;
+    AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+    ~AtomicFileWriter() { cancel(); }
+
+    bool open(const std::string& filename);
+    bool write(const void *data, size_t size);
+    bool commit(bool keepBackup = false);
+    void cancel();
+
+private:
+    std::string filename;
+
+#ifdef linux
+    int fd = -1;
+#else
+    std::FILE *file = nullptr;
+#endif
+    bool failed = false;
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <cmath>
+
+struct MapPoint
+{
+    float x, y;
+};
+
+// Axis aligned box in map coordinates.
+struct BlockBounds
+{
+    float left = 0.0f, top = 0.0f;
+    float right = -1.0f, bottom = -1.0f;
+
+    bool isEmpty() const { return right < left; }
+    bool intersects(const BlockBounds& other) const
+    {
+        return left <= other.right && other.left <= right && top <= other.bottom && other.top <= bottom;
+    }
+    bool contains(float x, float y) const { return x >= left && x <= right && y >= top && y <= bottom; }
+
+    // Grows the bounds to cover other too.
+    void add(const BlockBounds& other)
+    {
+        if ( isEmpty() )
+        {
+            *this = other;
+            return;
+        }
+
+        left   = std::fmin(left, other.left);
+        top    = std::fmin(top, other.top);
+        right  = std::fmax(right, other.right);
+        bottom = std::fmax(bottom, other.bottom);
+    }
+};
+
+// Bounds of a width*height block centered at x,y and rotated by angle degrees.
+inline BlockBounds getRotatedBounds(float x, float y, float angle, float width, float height)
+{
+    float radians = angle * 3.14159265f / 180.0f;
+    float c = std::fabs(std::cos(radians));
+    float s = std::fabs(std::sin(radians));
+
+    float halfWidth  = (width*c + height*s) / 2.0f;
+    float halfHeight = (width*s + height*c) / 2.0f;
+
+    return {x - halfWidth, y - halfHeight, x + halfWidth, y + halfHeight};
+}
+
+// Cosine and sine of a turn of angle degrees. Quarter turns are exact, so blocks on
+// whole positions stay on them, returns true for those.
+inline bool getTurn(float angle, float& cos, float& sin)
+{
+    float turns = angle / 90.0f;
+    if ( turns != std::floor(turns) )
+    {
+        float radians = angle * 3.14159265f / 180.0f;
+        cos = std::cos(radians);
+        sin = std::sin(radians);
+        return false;
+    }
+
+    int quarter = ((int)std::fmod(turns, 4.0f) + 4) % 4;
+    cos = quarter == 0 ? 1.0f : quarter == 2 ? -1.0f : 0.0f;
+    sin = quarter == 1 ? 1.0f : quarter == 3 ? -1.0f : 0.0f;
+    return true;
+}
+
+// Block angle turned by angle degrees, in [0, 360).
+inline float addAngle(float blockAngle, float angle)
+{
+    float result = std::fmod(blockAngle + angle, 360.0f);
+    return result < 0.0f ? result + 360.0f : result;
+}
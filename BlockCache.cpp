@@ -0,0 +1,154 @@
+#include "BlockCache.hpp"
+#include "AtomicWrite.hpp"
+#include <cstring>
+#include <algorithm>
+
+const size_t cacheHeaderSize = 16;
+const size_t cacheEntryFixedSize = 43;
+
+bool BlockCache::write(const std::string& filename, unsigned int pageSize,
+                       const std::vector<BlockCacheEntry>& entries, const std::vector<sf::Image>& pages)
+{
+    std::vector <char> buffer;
+
+    auto put = [&buffer](const void *data, size_t size) {
+        buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+    };
+    auto putInt = [&put](int value) { put(&value, 4); };
+
+    int entryCount = entries.size();
+    int pageCount = pages.size();
+
+    putInt(blockCacheID);
+    putInt(pageSize);
+    putInt(entryCount);
+    putInt(pageCount);
+
+    for ( const auto& entry : entries )
+    {
+        unsigned short pathSize = std::min<size_t>(entry.path.size(), 65535);
+        unsigned char nameSize = std::min<size_t>(entry.name.size(), 255);
+
+        putInt(entry.id);
+        put(&entry.fileSize, 8);
+        put(&entry.modified, 8);
+        putInt(entry.size.x);
+        putInt(entry.size.y);
+        putInt(entry.page);
+        putInt(entry.position.x);
+        putInt(entry.position.y);
+        put(&pathSize, 2);
+        put(&nameSize, 1);
+        put(entry.path.c_str(), pathSize);
+        put(entry.name.c_str(), nameSize);
+    }
+
+    for ( const auto& page : pages )
+    {
+        putInt(page.getSize().x);
+        putInt(page.getSize().y);
+        put(page.getPixelsPtr(), (size_t)page.getSize().x * page.getSize().y * 4);
+    }
+
+    return writeFileAtomic(filename, buffer.data(), buffer.size());
+}
+
+bool BlockCache::open(const std::string& filename)
+{
+    close();
+
+    if ( !file.open(filename) || file.getSize() < cacheHeaderSize )
+        return false;
+
+    const char *data = file.getData();
+    size_t size = file.getSize();
+    size_t position = cacheHeaderSize;
+
+    auto read = [data](void *target, size_t offset, size_t length) {
+        std::memcpy(target, data + offset, length);
+    };
+
+    int id = 0, entryCount = 0, pageCount = 0;
+    read(&id,           0,  4);
+    read(&pageSize,     4,  4);
+    read(&entryCount,   8,  4);
+    read(&pageCount,    12, 4);
+
+    if ( id != blockCacheID || entryCount < 0 || pageCount < 0 )
+    {
+        close();
+        return false;
+    }
+
+    entries.resize(entryCount);
+    for ( auto& entry : entries )
+    {
+        unsigned short pathSize = 0;
+        unsigned char nameSize = 0;
+
+        if ( size - position < cacheEntryFixedSize )
+        {
+            close();
+            return false;
+        }
+
+        read(&entry.id,             position,      4);
+        read(&entry.fileSize,       position + 4,  8);
+        read(&entry.modified,       position + 12, 8);
+        read(&entry.size.x,         position + 20, 4);
+        read(&entry.size.y,         position + 24, 4);
+        read(&entry.page,           position + 28, 4);
+        read(&entry.position.x,     position + 32, 4);
+        read(&entry.position.y,     position + 36, 4);
+        read(&pathSize,             position + 40, 2);
+        read(&nameSize,             position + 42, 1);
+        position += cacheEntryFixedSize;
+
+        if ( size - position < (size_t)pathSize + nameSize || entry.page >= pageCount )
+        {
+            close();
+            return false;
+        }
+
+        entry.path.assign(data + position, pathSize);
+        entry.name.assign(data + position + pathSize, nameSize);
+        position += pathSize + nameSize;
+    }
+
+    pages.resize(pageCount);
+    for ( auto& page : pages )
+    {
+        if ( size - position < 8 )
+        {
+            close();
+            return false;
+        }
+
+        read(&page.size.x, position,     4);
+        read(&page.size.y, position + 4, 4);
+        position += 8;
+
+        size_t pixelBytes = (size_t)page.size.x * page.size.y * 4;
+        if ( size - position < pixelBytes )
+        {
+            close();
+            return false;
+        }
+
+        page.pixels = (const sf::Uint8*)(data + position);
+        position += pixelBytes;
+    }
+
+    // Blocks have to be inside their pages.
+    for ( const auto& entry : entries )
+    {
+        if ( entry.page >= 0 && ((uint64_t)entry.position.x + entry.size.x > pages[entry.page].size.x ||
+                                 (uint64_t)entry.position.y + entry.size.y > pages[entry.page].size.y) )
+        {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "MappedFile.hpp"
+
+/*
+    Decoded block images and the atlas built from them, so an unchanged
+    blocks directory is not decoded again on the next start.
+
+    Block cache file [ BlkC ] = 0x436B6C42
+
+    int [FileFormat Descriptor] = BlkC (4 bytes)
+    int [Atlas page size]              (4 bytes)
+    int [Entry count]                  (4 bytes)
+    int [Page count]                   (4 bytes)
+
+    [ entry
+        - int id              - 4 bytes
+        - int64 file size     - 8 bytes
+        - int64 modified      - 8 bytes (file time ticks)
+        - int width, height   - 8 bytes
+        - int page, x, y      - 12 bytes (page is -1 when the image did not load)
+        - short path size     - 2 bytes
+        - char name size      - 1 byte
+        - char [][path]       - (path size * bytes)
+        - char [][name]       - (name size * bytes)
+    ] * Entry count
+
+    [ page
+        - int width, height   - 8 bytes
+        - RGBA pixels         - (width * height * 4 bytes)
+    ] * Page count
+ */
+
+const int blockCacheID = 0x436B6C42;     // BlkC
+
+struct BlockCacheEntry
+{
+    int id = 0;
+    std::string path;
+    std::string name;
+    uint64_t fileSize = 0;
+    int64_t modified = 0;
+
+    sf::Vector2u size;
+    int page = -1;
+    sf::Vector2u position;
+};
+
+class BlockCache
+{
+public:
+    struct Page
+    {
+        sf::Vector2u size;
+        const sf::Uint8 *pixels;        // Points to the mapped file
+    };
+
+    static bool write(const std::string& filename, unsigned int pageSize,
+                      const std::vector<BlockCacheEntry>& entries, const std::vector<sf::Image>& pages);
+
+    bool open(const std::string& filename);
+    void close() { file.close(); entries.clear(); pages.clear(); }
+
+    unsigned int getPageSize() const { return pageSize; }
+    const std::vector<BlockCacheEntry>& getEntries() const { return entries; }
+    const std::vector<Page>& getPages() const { return pages; }
+
+private:
+    MappedFile file;
+    unsigned int pageSize = 0;
+    std::vector <BlockCacheEntry> entries;
+    std::vector <Page> pages;
+};
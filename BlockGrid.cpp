@@ -0,0 +1,129 @@
+#include "BlockGrid.hpp"
+#include <algorithm>
+
+void BlockGrid::create(int width, int height, int cellSize)
+{
+    GridLayout::create(width, height, cellSize);
+    clear();
+}
+
+void BlockGrid::clear()
+{
+    cellStart.assign(columns * rows + 1, 0);
+    cellCount.assign(columns * rows, 0);
+    items.clear();
+    itemBoxes.clear();
+    itemCell.clear();
+    itemPosition.clear();
+    dirty = false;
+}
+
+void BlockGrid::build(const std::vector<int>& itemCells, const std::vector<BlockBounds>& itemBounds)
+{
+    int cellAmount = columns * rows;
+
+    std::fill(cellCount.begin(), cellCount.end(), 0);
+    for ( int cell : itemCells )
+        if ( cell >= 0 )
+            cellCount[cell]++;
+
+    // Leave a bit of slack on every cell so single inserts don't force a rebuild.
+    uint32_t position = 0;
+    for ( int c = 0; c < cellAmount; c++ )
+    {
+        cellStart[c] = position;
+        position += cellCount[c] + cellCount[c]/8 + 2;
+    }
+    cellStart[cellAmount] = position;
+
+    items.resize(position);
+    itemBoxes.resize(position);
+    itemCell = itemCells;
+    itemPosition.resize(itemCells.size());
+    std::fill(cellCount.begin(), cellCount.end(), 0);
+
+    for ( uint32_t c = 0; c < itemCells.size(); c++ )
+    {
+        int cell = itemCells[c];
+        if ( cell >= 0 )
+        {
+            itemPosition[c] = cellStart[cell] + cellCount[cell]++;
+            items[itemPosition[c]] = c;
+            itemBoxes[itemPosition[c]] = itemBounds[c];
+        }
+    }
+
+    dirty = false;
+}
+
+bool BlockGrid::insert(int cell, uint32_t item, const BlockBounds& bounds)
+{
+    if ( dirty || cellStart[cell] + cellCount[cell] >= cellStart[cell+1] )
+    {
+        dirty = true;
+        return false;
+    }
+
+    if ( item >= itemCell.size() )
+    {
+        itemCell.resize(item+1, -1);
+        itemPosition.resize(item+1);
+    }
+
+    uint32_t position = cellStart[cell] + cellCount[cell]++;
+    items[position] = item;
+    itemBoxes[position] = bounds;
+    itemCell[item] = cell;
+    itemPosition[item] = position;
+    return true;
+}
+
+void BlockGrid::remove(uint32_t item)
+{
+    if ( dirty || item >= itemCell.size() || itemCell[item] < 0 )
+        return;
+
+    int cell = itemCell[item];
+    uint32_t position = itemPosition[item];
+    uint32_t lastPosition = cellStart[cell] + cellCount[cell] - 1;
+
+    // Move the last item of the cell to the hole.
+    items[position] = items[lastPosition];
+    itemBoxes[position] = itemBoxes[lastPosition];
+    itemPosition[items[position]] = position;
+    cellCount[cell]--;
+
+    itemCell[item] = -1;
+}
+
+bool BlockGrid::update(int cell, uint32_t item, const BlockBounds& bounds)
+{
+    if ( dirty || item >= itemCell.size() || itemCell[item] != cell )
+        return false;
+
+    itemBoxes[itemPosition[item]] = bounds;
+    return true;
+}
+
+void BlockGrid::query(int x0, int y0, int x1, int y1, const BlockBounds& area, std::vector<uint32_t>& result) const
+{
+    x0 = std::max(x0, 0);
+    y0 = std::max(y0, 0);
+    x1 = std::min(x1, columns-1);
+    y1 = std::min(y1, rows-1);
+
+    for ( int y = y0; y <= y1; y++ )
+    {
+        // Cells of a row are back to back in the buffer.
+        int firstCell = y*columns + x0;
+        int lastCell = y*columns + x1;
+
+        for ( int cell = firstCell; cell <= lastCell; cell++ )
+        {
+            uint32_t end = cellStart[cell] + cellCount[cell];
+            for ( uint32_t position = cellStart[cell]; position < end; position++ )
+                if ( itemBoxes[position].intersects(area) )
+                    result.push_back(items[position]);
+        }
+    }
+}
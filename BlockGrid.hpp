@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "GridLayout.hpp"
+
+/*
+    Dense uniform grid over the whole map.
+
+    Cells are stored row by row. Every cell owns a contiguous range of the
+    shared item buffer (CSR layout):
+
+        items[cellStart[cell] .. cellStart[cell] + cellCount[cell])
+
+    The range between cellCount and the next cell's start is slack, so new
+    items can usually be placed without touching other cells. When a cell
+    runs out of slack the grid has to be rebuilt with build().
+
+    Every item remembers its cell and its position in the buffer, so removal
+    is a swap with the last item of the cell. The bounds of the items are
+    kept in the same order as the buffer, so a query reads them in one go
+    instead of looking each item up.
+ */
+
+class BlockGrid : public GridLayout
+{
+public:
+    void create(int width, int height, int cellSize);
+    void clear();
+
+    // Counting sort pass. Item N goes to the cell itemCells[N] with the bounds
+    // itemBounds[N], -1 skips the item.
+    void build(const std::vector<int>& itemCells, const std::vector<BlockBounds>& itemBounds);
+
+    // Returns false when the cell is full, caller needs to rebuild.
+    bool insert(int cell, uint32_t item, const BlockBounds& bounds);
+    void remove(uint32_t item);
+    // New bounds for an item that stays in cell. Returns false when the item
+    // is not in the cell, caller has to remove and insert it.
+    bool update(int cell, uint32_t item, const BlockBounds& bounds);
+
+    // Appends the items of the cells [x0..x1] x [y0..y1] whose bounds intersect area.
+    void query(int x0, int y0, int x1, int y1, const BlockBounds& area, std::vector<uint32_t>& result) const;
+
+    void markDirty() { dirty = true; }
+    bool isDirty() const { return dirty; }
+
+private:
+    std::vector <uint32_t> cellStart;   // columns*rows+1 entries, last one is the end of the buffer
+    std::vector <uint32_t> cellCount;   // Used items in the cell range
+    std::vector <uint32_t> items;
+    std::vector <BlockBounds> itemBoxes;    // Bounds of items[N]
+
+    std::vector <int> itemCell;             // Cell of the item, -1 if not in the grid
+    std::vector <uint32_t> itemPosition;    // Position of the item in items
+
+    bool dirty = false;
+};
@@ -0,0 +1,38 @@
+#include "BlockOrder.hpp"
+
+bool getBlockOrder(const BlockOrder& blockOrder, const Block *blocks, unsigned int count, std::vector<uint32_t>& order)
+{
+    std::vector <std::pair<uint64_t, uint32_t>> keys(count);
+
+    bool sorted = true;
+    for ( unsigned int c = 0; c < count; c++ )
+    {
+        keys[c] = {blockOrder.getKey(blocks[c]), c};
+        sorted = sorted && (c == 0 || keys[c-1].first <= keys[c].first);
+    }
+
+    if ( sorted )
+        return false;
+
+    // Index breaks the ties, same blocks keep their order.
+    std::sort(keys.begin(), keys.end());
+
+    order.resize(count);
+    for ( unsigned int c = 0; c < count; c++ )
+        order[c] = keys[c].second;
+
+    return true;
+}
+
+void sortBlocks(const BlockOrder& blockOrder, std::vector<Block>& blocks)
+{
+    std::vector <uint32_t> order;
+    if ( !getBlockOrder(blockOrder, blocks.data(), blocks.size(), order) )
+        return;
+
+    std::vector <Block> sorted(blocks.size());
+    for ( unsigned int c = 0; c < order.size(); c++ )
+        sorted[c] = blocks[order[c]];
+
+    blocks.swap(sorted);
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "BlockPool.hpp"
+#include "GridLayout.hpp"
+
+/*
+    Storage order of blocks, in memory and in map files.
+
+    Blocks are ordered by chunk, row by row like the chunks of a v2 file,
+    and inside a chunk by the Morton code (Z-order) of their position. The
+    Morton code interleaves the bits of x and y quantized over the map, so
+    blocks close to each other are close in the order too.
+ */
+
+// Spreads the low 16 bits of value to the even bits.
+inline uint32_t spreadBits(uint32_t value)
+{
+    value &= 0x0000FFFF;
+    value = (value | (value << 8)) & 0x00FF00FF;
+    value = (value | (value << 4)) & 0x0F0F0F0F;
+    value = (value | (value << 2)) & 0x33333333;
+    value = (value | (value << 1)) & 0x55555555;
+    return value;
+}
+
+struct BlockOrder
+{
+    GridLayout layout;
+    float scale = 1.0f;         // Map units to 16-bit steps, same for x and y
+
+    void create(int width, int height, int chunkSize)
+    {
+        layout.create(width, height, chunkSize);
+        scale = 65535.0f / std::max(std::max(width, height), 1);
+    }
+
+    uint32_t getMortonCode(float x, float y) const
+    {
+        // Also NaN goes to 0.
+        float stepX = x * scale;
+        float stepY = y * scale;
+        uint32_t codeX = stepX > 0.0f ? (uint32_t)std::min(stepX, 65535.0f) : 0;
+        uint32_t codeY = stepY > 0.0f ? (uint32_t)std::min(stepY, 65535.0f) : 0;
+
+        return spreadBits(codeX) | (spreadBits(codeY) << 1);
+    }
+
+    uint64_t getKey(const Block& block) const
+    {
+        return (uint64_t)layout.getCell(block.x, block.y) << 32 | getMortonCode(block.x, block.y);
+    }
+};
+
+// order gets the indices of blocks in the storage order. Returns false when
+// the blocks were in order already, order is not touched then.
+bool getBlockOrder(const BlockOrder& blockOrder, const Block *blocks, unsigned int count, std::vector<uint32_t>& order);
+
+// Sorts blocks to the storage order.
+void sortBlocks(const BlockOrder& blockOrder, std::vector<Block>& blocks);
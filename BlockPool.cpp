@@ -0,0 +1,135 @@
+#include "BlockPool.hpp"
+#include <cstring>
+
+BlockHandle BlockPool::add(const Block& block)
+{
+    uint32_t slot = firstFree;
+
+    if ( slot != freeSlot )
+    {
+        firstFree = slots[slot].nextFree;
+    }
+    else
+    {
+        slot = slots.size();
+        slots.push_back({freeSlot, 1, freeSlot});
+    }
+
+    slots[slot].position = blocks.size();
+    blocks.push_back(block);
+    blockSlots.push_back(slot);
+    changeCount++;
+
+    return {slot, slots[slot].generation};
+}
+
+void BlockPool::remove(BlockHandle handle)
+{
+    if ( !isValid(handle) )
+        return;
+
+    uint32_t position = slots[handle.index].position;
+    uint32_t lastPosition = blocks.size()-1;
+
+    // Move the last block to the hole.
+    if ( position != lastPosition )
+    {
+        blocks[position] = blocks[lastPosition];
+        blockSlots[position] = blockSlots[lastPosition];
+        slots[blockSlots[position]].position = position;
+    }
+
+    blocks.pop_back();
+    blockSlots.pop_back();
+
+    Slot& slot = slots[handle.index];
+    slot.position = freeSlot;
+    slot.generation++;
+    slot.nextFree = firstFree;
+    firstFree = handle.index;
+    changeCount++;
+}
+
+void BlockPool::clear()
+{
+    blocks.clear();
+    blockSlots.clear();
+    changeCount++;
+
+    // Put every slot back to the free list, lowest slot first.
+    firstFree = freeSlot;
+    for ( uint32_t c = slots.size(); c-- > 0; )
+    {
+        if ( slots[c].position != freeSlot )
+            slots[c].generation++;
+
+        slots[c].position = freeSlot;
+        slots[c].nextFree = firstFree;
+        firstFree = c;
+    }
+}
+
+void BlockPool::assign(const void *blockData, unsigned int count)
+{
+    clear();
+
+    blocks.resize(count);
+    if ( count > 0 )
+        std::memcpy(blocks.data(), blockData, count * sizeof(Block));
+
+    if ( slots.size() < count )
+        slots.resize(count, {freeSlot, 1, freeSlot});
+
+    // Block N goes to slot N, rest of the slots stay free.
+    blockSlots.resize(count);
+    for ( uint32_t c = 0; c < count; c++ )
+    {
+        blockSlots[c] = c;
+        slots[c].position = c;
+    }
+
+    firstFree = freeSlot;
+    for ( uint32_t c = slots.size(); c-- > count; )
+    {
+        slots[c].nextFree = firstFree;
+        firstFree = c;
+    }
+}
+
+void BlockPool::reserve(unsigned int count)
+{
+    blocks.reserve(count);
+    blockSlots.reserve(count);
+    slots.reserve(count);
+}
+
+void BlockPool::reorder(const std::vector<uint32_t>& order)
+{
+    std::vector <Block> sortedBlocks(blocks.size());
+    std::vector <uint32_t> sortedSlots(blocks.size());
+
+    for ( uint32_t c = 0; c < order.size(); c++ )
+    {
+        sortedBlocks[c] = blocks[order[c]];
+        sortedSlots[c] = blockSlots[order[c]];
+        slots[sortedSlots[c]].position = c;
+    }
+
+    blocks.swap(sortedBlocks);
+    blockSlots.swap(sortedSlots);
+    changeCount++;
+}
+
+void BlockPool::setOrder(std::vector<Block>&& sortedBlocks, std::vector<uint32_t>&& sortedSlots,
+                         const std::vector<uint32_t>& slotPositions)
+{
+    blocks.swap(sortedBlocks);
+    blockSlots.swap(sortedSlots);
+
+    // Slot by slot, so the table is gone through in memory order.
+    for ( uint32_t slot = 0; slot < slots.size(); slot++ )
+        if ( slots[slot].position != freeSlot )
+            slots[slot].position = slotPositions[slot];
+
+    changeCount++;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+struct Block
+{
+    float x, y;
+    float angle;
+
+    int id;
+};
+
+// Stable reference to a block in BlockPool. Goes stale when the block is removed.
+struct BlockHandle
+{
+    static const uint32_t invalidIndex = 0xFFFFFFFF;
+
+    uint32_t index = invalidIndex;  // Slot in the pool
+    uint32_t generation = 0;        // Slot generation when the handle was made
+
+    bool isValid() const { return index != invalidIndex; }
+
+    bool operator==(const BlockHandle& other) const { return index == other.index && generation == other.generation; }
+    bool operator!=(const BlockHandle& other) const { return !(*this == other); }
+};
+
+/*
+    Keeps all blocks of the map packed in one contiguous array.
+
+    Removing a block moves the last block into its place, so the array never
+    has holes. Handles go through a slot table that knows where the block
+    currently is and which generation the slot is on, so a handle to a
+    removed block is detected instead of pointing to some other block.
+ */
+
+class BlockPool
+{
+public:
+    BlockHandle add(const Block& block);
+    void remove(BlockHandle handle);
+
+    // Replaces all blocks with count packed blocks from blockData (may be unaligned).
+    void assign(const void *blockData, unsigned int count);
+
+    // Removes all blocks but keeps the memory. Old handles become stale.
+    void clear();
+    void reserve(unsigned int count);
+
+    // Moves the block at position order[N] to position N. Handles stay valid.
+    void reorder(const std::vector<uint32_t>& order);
+    // Same for an order made elsewhere from a copy of the blocks, only while nothing
+    // has changed since the copy. sortedSlots[N] is the slot of sortedBlocks[N] and
+    // slotPositions has the new position of every slot.
+    void setOrder(std::vector<Block>&& sortedBlocks, std::vector<uint32_t>&& sortedSlots,
+                  const std::vector<uint32_t>& slotPositions);
+    // Goes up on every add, remove and reorder, to tell when positions are not the same any more.
+    uint64_t getChangeCount() const { return changeCount; }
+    // After count blocks were changed in place, a copy taken before is out of date then.
+    void markChanged(unsigned int count = 1) { changeCount += count; }
+
+    bool isValid(BlockHandle handle) const
+    {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+               slots[handle.index].position != freeSlot;
+    }
+
+    Block *get(BlockHandle handle) { return isValid(handle) ? &blocks[slots[handle.index].position] : nullptr; }
+    const Block *get(BlockHandle handle) const { return isValid(handle) ? &blocks[slots[handle.index].position] : nullptr; }
+
+    // Access by slot index, which is what the grid cells store.
+    Block& getBySlot(uint32_t slot) { return blocks[slots[slot].position]; }
+    const Block& getBySlot(uint32_t slot) const { return blocks[slots[slot].position]; }
+    BlockHandle getHandleBySlot(uint32_t slot) const { return {slot, slots[slot].generation}; }
+    bool isSlotUsed(uint32_t slot) const { return slots[slot].position != freeSlot; }
+    uint32_t getSlotCount() const { return slots.size(); }
+
+    // Dense access, in storage order.
+    unsigned int size() const { return blocks.size(); }
+    bool empty() const { return blocks.empty(); }
+    Block& operator[](unsigned int position) { return blocks[position]; }
+    const Block& operator[](unsigned int position) const { return blocks[position]; }
+    BlockHandle getHandle(unsigned int position) const { return getHandleBySlot(blockSlots[position]); }
+    uint32_t getSlot(unsigned int position) const { return blockSlots[position]; }
+
+    std::vector<Block>::iterator begin() { return blocks.begin(); }
+    std::vector<Block>::iterator end() { return blocks.end(); }
+    std::vector<Block>::const_iterator begin() const { return blocks.begin(); }
+    std::vector<Block>::const_iterator end() const { return blocks.end(); }
+
+private:
+    static const uint32_t freeSlot = 0xFFFFFFFF;
+
+    struct Slot
+    {
+        uint32_t position;      // Position in blocks, freeSlot if unused
+        uint32_t generation;
+        uint32_t nextFree;      // Next unused slot when this one is unused
+    };
+
+    std::vector <Block> blocks;         // Packed block data
+    std::vector <uint32_t> blockSlots;  // Slot of each block in blocks
+    std::vector <Slot> slots;
+
+    uint32_t firstFree = freeSlot;
+    uint64_t changeCount = 0;
+};
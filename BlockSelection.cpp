@@ -0,0 +1,66 @@
+#include "BlockSelection.hpp"
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Index of the lowest set bit, value can't be 0.
+static unsigned int getLowestBit(uint64_t value)
+{
+#if defined(_MSC_VER) && defined(_WIN64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return index;
+#elif defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    unsigned int index = 0;
+    for ( ; !(value & 1); value >>= 1 )
+        index++;
+    return index;
+#endif
+}
+
+void BlockSelection::clear()
+{
+    if ( count > 0 )
+        std::fill(bits.begin(), bits.end(), 0);
+    count = 0;
+}
+
+bool BlockSelection::add(uint32_t slot)
+{
+    if ( slot / 64 >= bits.size() )
+        bits.resize(slot / 64 + 1, 0);
+
+    uint64_t bit = (uint64_t)1 << (slot % 64);
+    if ( bits[slot / 64] & bit )
+        return false;
+
+    bits[slot / 64] |= bit;
+    count++;
+    return true;
+}
+
+bool BlockSelection::remove(uint32_t slot)
+{
+    if ( !contains(slot) )
+        return false;
+
+    bits[slot / 64] &= ~((uint64_t)1 << (slot % 64));
+    count--;
+    return true;
+}
+
+void BlockSelection::getSlots(std::vector<uint32_t>& result) const
+{
+    size_t end = result.size() + count;
+
+    for ( uint32_t word = 0; word < bits.size() && result.size() < end; word++ )
+    {
+        // Lowest set bit first.
+        for ( uint64_t value = bits[word]; value != 0; value &= value - 1 )
+            result.push_back(word * 64 + getLowestBit(value));
+    }
+}
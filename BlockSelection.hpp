@@ -0,0 +1,35 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+/*
+    Set of selected blocks, one bit for every slot of BlockPool.
+
+    A slot has to be removed from the selection when its block is removed,
+    so a block that gets the slot later is not selected.
+ */
+
+class BlockSelection
+{
+public:
+    void clear();
+
+    // Both return true when the selection changed.
+    bool add(uint32_t slot);
+    bool remove(uint32_t slot);
+
+    bool contains(uint32_t slot) const
+    {
+        return slot / 64 < bits.size() && (bits[slot / 64] >> (slot % 64) & 1) != 0;
+    }
+
+    unsigned int size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    // Appends the selected slots, lowest first.
+    void getSlots(std::vector<uint32_t>& result) const;
+
+private:
+    std::vector <uint64_t> bits;
+    unsigned int count = 0;
+};
@@ -0,0 +1,79 @@
+#include "BlockSorter.hpp"
+
+bool BlockSorter::start(const BlockOrder& blockOrder, const BlockPool& pool)
+{
+    if ( isRunning() )
+        return false;
+
+    this->blockOrder = blockOrder;
+    changeCount = pool.getChangeCount();
+
+    blocks.assign(pool.begin(), pool.end());
+    blockSlots.resize(pool.size());
+    for ( unsigned int c = 0; c < pool.size(); c++ )
+        blockSlots[c] = pool.getSlot(c);
+    slotCount = pool.getSlotCount();
+
+    changed = false;
+    finished = false;
+
+    thread = std::thread(&BlockSorter::run, this);
+    return true;
+}
+
+bool BlockSorter::finish()
+{
+    if ( !thread.joinable() )
+        return false;
+
+    thread.join();
+    return changed;
+}
+
+bool BlockSorter::apply(BlockPool& pool)
+{
+    bool result = changed && !isRunning() && pool.getChangeCount() == changeCount;
+
+    if ( result )
+        pool.setOrder(std::move(blocks), std::move(blockSlots), slotPositions);
+
+    clear();
+    return result;
+}
+
+void BlockSorter::clear()
+{
+    finish();
+
+    changed = false;
+    blocks = std::vector<Block>();
+    blockSlots = std::vector<uint32_t>();
+    slotPositions = std::vector<uint32_t>();
+}
+
+void BlockSorter::run()
+{
+    // Everything is sorted here, apply() only swaps the arrays.
+    std::vector <uint32_t> order;
+    changed = getBlockOrder(blockOrder, blocks.data(), blocks.size(), order);
+
+    if ( changed )
+    {
+        slotPositions.assign(slotCount, 0);
+
+        std::vector <Block> sortedBlocks(blocks.size());
+        std::vector <uint32_t> sortedSlots(blocks.size());
+
+        for ( unsigned int c = 0; c < order.size(); c++ )
+        {
+            sortedBlocks[c] = blocks[order[c]];
+            sortedSlots[c] = blockSlots[order[c]];
+            slotPositions[sortedSlots[c]] = c;
+        }
+
+        blocks.swap(sortedBlocks);
+        blockSlots.swap(sortedSlots);
+    }
+
+    finished = true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "BlockOrder.hpp"
+
+/*
+    Sorts a copy of the blocks to the storage order on a background thread,
+    so the frame does not wait for it. The sorted copy is moved to the pool
+    with apply() in one pass, if the pool has not changed meanwhile.
+ */
+
+class BlockSorter
+{
+public:
+    ~BlockSorter() { finish(); }
+
+    // Takes a copy of the pool. Returns false when a sort is already running.
+    bool start(const BlockOrder& blockOrder, const BlockPool& pool);
+
+    bool isRunning() const { return thread.joinable(); }
+    bool isFinished() const { return finished; }
+
+    // Waits for the thread. Returns false when the blocks were in order already.
+    bool finish();
+    // Puts the pool to the sorted order after finish(). Returns false when
+    // the pool has changed since start(), the order is thrown away then.
+    bool apply(BlockPool& pool);
+    // Waits for the thread and drops the copy.
+    void clear();
+
+private:
+    void run();
+
+    BlockOrder blockOrder;
+    uint64_t changeCount = 0;           // Of the pool when copied
+    uint32_t slotCount = 0;
+    std::vector <Block> blocks;
+    std::vector <uint32_t> blockSlots;
+    std::vector <uint32_t> slotPositions;
+    bool changed = false;
+
+    std::thread thread;
+    std::atomic <bool> finished{false};
+};
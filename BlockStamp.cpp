@@ -0,0 +1,88 @@
+#include "BlockStamp.hpp"
+#include <cmath>
+
+void BlockStamp::create(const std::vector<Block>& blocks, const BlockBounds& bounds)
+{
+    clear();
+    if ( blocks.empty() || bounds.isEmpty() )
+        return;
+
+    float centerX = (bounds.left + bounds.right) / 2.0f;
+    float centerY = (bounds.top + bounds.bottom) / 2.0f;
+    halfWidth = (bounds.right - bounds.left) / 2.0f;
+    halfHeight = (bounds.bottom - bounds.top) / 2.0f;
+
+    this->blocks.reserve(blocks.size());
+    for ( const Block& block : blocks )
+        this->blocks.push_back({block.x - centerX, block.y - centerY, block.angle, block.id});
+}
+
+void BlockStamp::clear()
+{
+    blocks.clear();
+    halfWidth = 0.0f;
+    halfHeight = 0.0f;
+}
+
+void BlockStamp::place(float x, float y, float angle, std::vector<Block>& result) const
+{
+    float cos, sin;
+    getTurn(angle, cos, sin);
+
+    size_t first = result.size();
+    result.resize(first + blocks.size());
+
+    Block *target = result.data() + first;
+    for ( const Block& block : blocks )
+        *target++ = {x + block.x*cos - block.y*sin, y + block.x*sin + block.y*cos, addAngle(block.angle, angle), block.id};
+}
+
+void BlockStamp::getTiles(const BlockBounds& area, float angle, float& tileWidth, float& tileHeight,
+                          double& columns, double& rows) const
+{
+    // Covered area after the turn.
+    float cos, sin;
+    getTurn(angle, cos, sin);
+    tileWidth = 2.0f * (halfWidth*std::fabs(cos) + halfHeight*std::fabs(sin));
+    tileHeight = 2.0f * (halfWidth*std::fabs(sin) + halfHeight*std::fabs(cos));
+
+    // Stamps of single points have no size, they are placed one unit apart.
+    tileWidth = std::fmax(tileWidth, 1.0f);
+    tileHeight = std::fmax(tileHeight, 1.0f);
+
+    columns = std::floor(((double)area.right - area.left) / tileWidth);
+    rows = std::floor(((double)area.bottom - area.top) / tileHeight);
+}
+
+unsigned int BlockStamp::getTileBlockCount(const BlockBounds& area, float angle) const
+{
+    float tileWidth, tileHeight;
+    double columns, rows;
+    getTiles(area, angle, tileWidth, tileHeight, columns, rows);
+
+    // Also NaN areas fit none.
+    if ( blocks.empty() || !(columns >= 1.0 && rows >= 1.0) )
+        return 0;
+
+    double count = columns * rows * blocks.size();
+    return count > maxTileBlocks ? maxTileBlocks + 1 : (unsigned int)count;
+}
+
+bool BlockStamp::tile(const BlockBounds& area, float angle, std::vector<Block>& result) const
+{
+    unsigned int count = getTileBlockCount(area, angle);
+    if ( count == 0 || count > maxTileBlocks )
+        return false;
+
+    float tileWidth, tileHeight;
+    double columns, rows;
+    getTiles(area, angle, tileWidth, tileHeight, columns, rows);
+
+    result.reserve(result.size() + count);
+
+    for ( int row = 0; row < (int)rows; row++ )
+        for ( int column = 0; column < (int)columns; column++ )
+            place(area.left + (column + 0.5f) * tileWidth, area.top + (row + 0.5f) * tileHeight, angle, result);
+
+    return true;
+}
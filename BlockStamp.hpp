@@ -0,0 +1,46 @@
+#pragma once
+#include <vector>
+
+#include "BlockPool.hpp"
+#include "BlockBounds.hpp"
+
+const unsigned int maxTileBlocks = 1 << 20;    // Most blocks one tile places, bigger areas are refused
+
+/*
+    Group of blocks placed as one, for copy and paste and the stamps of the
+    editor.
+
+    Blocks are kept in one array relative to the center of the area they
+    cover, so a stamp can be placed anywhere and turned about its center.
+    Placing only writes the blocks to a buffer, the caller inserts them in
+    one go.
+ */
+
+class BlockStamp
+{
+public:
+    // bounds is the area the blocks cover, tiles are placed by it.
+    void create(const std::vector<Block>& blocks, const BlockBounds& bounds);
+    void clear();
+
+    unsigned int size() const { return blocks.size(); }
+    bool empty() const { return blocks.empty(); }
+
+    // Appends the blocks turned angle degrees and centered at x,y.
+    void place(float x, float y, float angle, std::vector<Block>& result) const;
+    // Appends turned copies side by side over area, as many as fit whole. False and
+    // nothing appended when none fit or they would be over maxTileBlocks blocks.
+    bool tile(const BlockBounds& area, float angle, std::vector<Block>& result) const;
+    // Blocks tile would place, maxTileBlocks + 1 for anything over the limit.
+    unsigned int getTileBlockCount(const BlockBounds& area, float angle) const;
+
+private:
+    // Size of one turned copy and the copies that fit in area, counted in
+    // double so huge areas can't overflow.
+    void getTiles(const BlockBounds& area, float angle, float& tileWidth, float& tileHeight,
+                  double& columns, double& rows) const;
+
+    std::vector <Block> blocks;         // Relative to the center
+    float halfWidth = 0.0f;             // Of the covered area
+    float halfHeight = 0.0f;
+};
@@ -0,0 +1,115 @@
+#include "ChunkRenderer.hpp"
+#include "Resources.hpp"
+#include <algorithm>
+
+void ChunkRenderer::create(int width, int height, int chunkSize)
+{
+    layout.create(width, height, chunkSize);
+    clear();
+}
+
+void ChunkRenderer::clear()
+{
+    chunks.clear();
+    chunks.resize(layout.getCellCount());
+    overhang = 0.0f;
+}
+
+int ChunkRenderer::getChunk(float x, float y) const
+{
+    return layout.getCell(x, y);
+}
+
+void ChunkRenderer::invalidate(float x, float y, const BlockBounds& bounds)
+{
+    if ( chunks.empty() )
+        return;
+
+    int index = getChunk(x, y);
+    Chunk& chunk = chunks[index];
+
+    chunk.dirty = true;
+
+    chunk.bounds.add(bounds);
+
+    BlockBounds area = getChunkArea(index);
+    overhang = std::max({overhang, area.left - bounds.left, area.top - bounds.top,
+                         bounds.right - area.right, bounds.bottom - area.bottom});
+}
+
+void ChunkRenderer::invalidate(float x, float y)
+{
+    if ( !chunks.empty() )
+        chunks[getChunk(x, y)].dirty = true;
+}
+
+void ChunkRenderer::invalidateAll()
+{
+    for ( auto& chunk : chunks )
+        chunk.dirty = true;
+}
+
+void ChunkRenderer::getVisibleChunks(const BlockBounds& area, std::vector<int>& result) const
+{
+    if ( chunks.empty() )
+        return;
+
+    int first = getChunk(area.left - overhang, area.top - overhang);
+    int last  = getChunk(area.right + overhang, area.bottom + overhang);
+
+    int columns = layout.getColumns();
+
+    for ( int y = first / columns; y <= last / columns; y++ )
+    {
+        for ( int x = first % columns; x <= last % columns; x++ )
+        {
+            int index = y * columns + x;
+            if ( !chunks[index].bounds.isEmpty() && chunks[index].bounds.intersects(area) )
+                result.push_back(index);
+        }
+    }
+}
+
+void ChunkRenderer::setGeometry(int chunk, const std::vector<std::vector<sf::Vertex>>& pageVertices, const BlockBounds& bounds)
+{
+    Chunk& target = chunks[chunk];
+
+    for ( auto& chunkPage : target.pages )
+        chunkPage.vertexCount = 0;
+
+    for ( unsigned int page = 0; page < pageVertices.size(); page++ )
+    {
+        const std::vector <sf::Vertex>& vertices = pageVertices[page];
+        if ( vertices.empty() )
+            continue;
+
+        // Pages are kept in order, they are drawn page by page like Map::getBlockAt picks.
+        auto it = std::lower_bound(target.pages.begin(), target.pages.end(), (int)page,
+                                   [](const ChunkPage& chunkPage, int wanted) { return chunkPage.page < wanted; });
+
+        if ( it == target.pages.end() || it->page != (int)page )
+            it = target.pages.insert(it, {(int)page, 0, sf::VertexBuffer(sf::Quads, sf::VertexBuffer::Static)});
+
+        // Buffer only grows, so removing blocks doesn't reallocate.
+        if ( it->buffer.getVertexCount() < vertices.size() )
+            it->buffer.create(vertices.size() + vertices.size()/4);
+
+        it->buffer.update(vertices.data(), vertices.size(), 0);
+        it->vertexCount = vertices.size();
+    }
+
+    target.bounds = bounds;
+    target.dirty = false;
+    target.version++;
+}
+
+void ChunkRenderer::draw(sf::RenderTarget& target, int chunk, class Resources *res)
+{
+    for ( auto& chunkPage : chunks[chunk].pages )
+    {
+        if ( chunkPage.vertexCount == 0 )
+            continue;
+
+        target.draw(chunkPage.buffer, 0, chunkPage.vertexCount, res->getAtlasPage(chunkPage.page));
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+#include "SpatialIndex.hpp"
+#include "GridLayout.hpp"
+
+/*
+    Keeps the quads of the map on the GPU, one sf::VertexBuffer per atlas
+    page per chunk. A chunk is a square of the map, a block belongs to the
+    chunk where its center is.
+
+    Chunks are marked dirty when their blocks change and only dirty chunks
+    that are on camera get their geometry uploaded again. The bounds of a
+    chunk cover every block in it, so blocks hanging over the chunk edge
+    are drawn too.
+ */
+
+class ChunkRenderer
+{
+public:
+    void create(int width, int height, int chunkSize);
+    void clear();
+
+    int getChunk(float x, float y) const;
+    int getChunkCount() const { return chunks.size(); }
+
+    // Area where blocks of the chunk have their center.
+    BlockBounds getChunkArea(int chunk) const { return layout.getCellArea(chunk); }
+
+    // Marks chunk of the block at x,y dirty, bounds are the block bounds.
+    void invalidate(float x, float y, const BlockBounds& bounds);
+    void invalidate(float x, float y);
+    void invalidateAll();
+
+    bool isDirty(int chunk) const { return chunks[chunk].dirty; }
+    const BlockBounds& getBounds(int chunk) const { return chunks[chunk].bounds; }
+
+    // Changes every time the geometry of the chunk is set.
+    unsigned int getVersion(int chunk) const { return chunks[chunk].version; }
+
+    // Chunks whose bounds intersect area.
+    void getVisibleChunks(const BlockBounds& area, std::vector<int>& result) const;
+
+    // pageVertices[page] has the quads of the chunk on that atlas page.
+    void setGeometry(int chunk, const std::vector<std::vector<sf::Vertex>>& pageVertices, const BlockBounds& bounds);
+
+    void draw(sf::RenderTarget& target, int chunk, class Resources *res);
+
+private:
+    struct ChunkPage
+    {
+        int page;
+        unsigned int vertexCount;
+        sf::VertexBuffer buffer;
+    };
+
+    struct Chunk
+    {
+        bool dirty = false;
+        unsigned int version = 0;
+        BlockBounds bounds;                 // Empty when the chunk has no blocks
+        std::vector <ChunkPage> pages;
+    };
+
+    std::vector <Chunk> chunks;
+
+    GridLayout layout;
+
+    float overhang = 0.0f;                  // How far any chunk bounds reach over the chunk area
+};
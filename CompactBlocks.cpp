@@ -0,0 +1,214 @@
+#include "CompactBlocks.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+const float angleStep = 360.0f / 65536.0f;
+
+// Bit for bit, so -0 and NaN payloads are not taken as equal.
+static bool isSame(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+template <class ForEachBlock>
+void CompactBlocks::build(const MapFile& info, int chunkSize, bool keepExact, ForEachBlock forEachBlock)
+{
+    this->info = info;
+    this->keepExact = keepExact;
+    layout.create(info.width, info.height, chunkSize);
+
+    int scale = 1;
+    while ( scale < layout.getCellSize() )
+        scale *= 2;
+    step = scale / 65536.0f;
+
+    // Counting sort by chunk, same as BlockGrid, but only the chunks with
+    // blocks are kept. fill by cell is needed only here.
+    std::vector <uint32_t> fill(layout.getCellCount(), 0);
+
+    forEachBlock([this, &fill](const Block& block) {
+        fill[layout.getCell(block.x, block.y)]++;
+    });
+
+    chunks.clear();
+    for ( int c = 0; c < layout.getCellCount(); c++ )
+        if ( fill[c] > 0 )
+            chunks.push_back(c);
+    chunks.shrink_to_fit();
+
+    chunkStart.assign(chunks.size()+1, 0);
+
+    for ( unsigned int c = 0; c < chunks.size(); c++ )
+    {
+        chunkStart[c+1] = chunkStart[c] + fill[chunks[c]];
+        fill[chunks[c]] = chunkStart[c];
+    }
+
+    unsigned int count = chunkStart.back();
+    x.assign(count, 0);
+    y.assign(count, 0);
+    angle.assign(count, 0);
+    id.assign(count, 0);
+    exactAt.clear();
+    exact.clear();
+
+    std::vector <std::pair<uint32_t, Block>> exactBlocks;
+
+    forEachBlock([&](const Block& block) {
+        int chunk = layout.getCell(block.x, block.y);
+        uint32_t place = fill[chunk]++;
+
+        uint16_t values[4];
+        if ( encode(block, chunk, values) )
+        {
+            x[place] = values[0];
+            y[place] = values[1];
+            angle[place] = values[2];
+            id[place] = values[3];
+        }
+        else
+            exactBlocks.push_back({place, block});
+    });
+
+    std::sort(exactBlocks.begin(), exactBlocks.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for ( const auto& exactBlock : exactBlocks )
+    {
+        exactAt.push_back(exactBlock.first);
+        exact.push_back(exactBlock.second);
+    }
+}
+
+void CompactBlocks::build(const MapFile& info, const Block *blocks, unsigned int count, int chunkSize, bool keepExact)
+{
+    build(info, chunkSize, keepExact, [blocks, count](auto function) {
+        for ( unsigned int c = 0; c < count; c++ )
+            function(blocks[c]);
+    });
+}
+
+void CompactBlocks::load(const MapReader& reader, int chunkSize, bool keepExact)
+{
+    // The file is gone through twice a chunk at a time, it is never copied as a whole.
+    std::vector <Block> buffer;
+
+    build(reader.getInfo(), chunkSize, keepExact, [&reader, &buffer](auto function) {
+        for ( unsigned int c = 0; c < reader.getChunks().size(); c++ )
+        {
+            buffer.clear();
+            reader.readChunk(c, buffer);
+
+            for ( const Block& block : buffer )
+                function(block);
+        }
+    });
+}
+
+void CompactBlocks::clear()
+{
+    // Assigned over, so the memory of the arrays is given back.
+    *this = CompactBlocks();
+}
+
+bool CompactBlocks::encode(const Block& block, int chunk, uint16_t *result) const
+{
+    float originX = getOriginX(chunk);
+    float originY = getOriginY(chunk);
+    float values[3] = {(block.x - originX) / step, (block.y - originY) / step, block.angle / angleStep};
+
+    for ( int c = 0; c < 3; c++ )
+    {
+        if ( !(values[c] >= 0.0f && values[c] <= 65535.0f) )
+            return false;
+        result[c] = (uint16_t)std::lround(values[c]);
+    }
+
+    if ( block.id < 0 || block.id > 65535 )
+        return false;
+    result[3] = block.id;
+
+    if ( !keepExact )
+        return true;
+
+    // Has to decode to the same bits.
+    return isSame(originX + result[0] * step, block.x) && isSame(originY + result[1] * step, block.y) &&
+           isSame(result[2] * angleStep, block.angle);
+}
+
+int CompactBlocks::findChunk(int chunk) const
+{
+    auto at = std::lower_bound(chunks.begin(), chunks.end(), chunk);
+    return at != chunks.end() && *at == chunk ? at - chunks.begin() : -1;
+}
+
+unsigned int CompactBlocks::getChunkBlockCount(int chunk) const
+{
+    int entry = findChunk(chunk);
+    return entry >= 0 ? chunkStart[entry+1] - chunkStart[entry] : 0;
+}
+
+void CompactBlocks::decodeChunk(int chunk, std::vector<Block>& result) const
+{
+    int entry = findChunk(chunk);
+    if ( entry >= 0 )
+        decodeEntry(entry, result);
+}
+
+void CompactBlocks::decodeEntry(int entry, std::vector<Block>& result) const
+{
+    float originX = getOriginX(chunks[entry]);
+    float originY = getOriginY(chunks[entry]);
+
+    uint32_t first = chunkStart[entry];
+    uint32_t last = chunkStart[entry+1];
+    size_t resultFirst = result.size();
+    result.resize(resultFirst + (last - first));
+
+    Block *target = result.data() + resultFirst;
+    for ( uint32_t c = first; c < last; c++ )
+        *target++ = {originX + x[c] * step, originY + y[c] * step, angle[c] * angleStep, id[c]};
+
+    // Exact blocks over their places.
+    for ( auto at = std::lower_bound(exactAt.begin(), exactAt.end(), first); at != exactAt.end() && *at < last; at++ )
+        result[resultFirst + (*at - first)] = exact[at - exactAt.begin()];
+}
+
+void CompactBlocks::queryArea(const BlockBounds& area, float margin, std::vector<Block>& result) const
+{
+    if ( chunks.empty() )
+        return;
+
+    BlockBounds grown = {area.left - margin, area.top - margin, area.right + margin, area.bottom + margin};
+
+    // Blocks are in the chunk of their center, so only the chunks under the area can have any.
+    // Chunks are in row order, each row of the area is one run of them.
+    for ( int cellY = layout.getCellY(grown.top); cellY <= layout.getCellY(grown.bottom); cellY++ )
+    {
+        int firstChunk = cellY * layout.getColumns() + layout.getCellX(grown.left);
+        int lastChunk = cellY * layout.getColumns() + layout.getCellX(grown.right);
+
+        for ( auto at = std::lower_bound(chunks.begin(), chunks.end(), firstChunk); at != chunks.end() && *at <= lastChunk; at++ )
+        {
+            size_t first = result.size();
+            decodeEntry(at - chunks.begin(), result);
+
+            // Chunks inside the area are kept whole, block centers are in their chunk area.
+            BlockBounds chunkArea = layout.getCellArea(*at);
+            if ( grown.contains(chunkArea.left, chunkArea.top) && grown.contains(chunkArea.right, chunkArea.bottom) )
+                continue;
+
+            size_t kept = first;
+            for ( size_t b = first; b < result.size(); b++ )
+                if ( grown.contains(result[b].x, result[b].y) )
+                    result[kept++] = result[b];
+            result.resize(kept);
+        }
+    }
+}
+
+size_t CompactBlocks::getMemoryUsage() const
+{
+    return chunks.capacity() * sizeof(int) + chunkStart.capacity() * sizeof(uint32_t) +
+           (x.capacity() + y.capacity() + angle.capacity() + id.capacity()) * sizeof(uint16_t) +
+           exactAt.capacity() * sizeof(uint32_t) + exact.capacity() * sizeof(Block);
+}
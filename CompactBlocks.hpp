@@ -0,0 +1,73 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "BlockPool.hpp"
+#include "MapFormat.hpp"
+#include "GridLayout.hpp"
+
+/*
+    Read only blocks of a map in 8 bytes a block instead of 16, for views
+    of huge maps that are not edited. The editor keeps a map loaded with
+    Map::viewMap like this, mapTool stats tells what a map takes in it.
+
+    Blocks are sorted by chunk like in BlockGrid and kept in separate
+    arrays of 16-bit values:
+        x, y    fixed point from the chunk corner in steps of scale/65536,
+                where scale is the chunk size rounded up to a power of two,
+                so whole and half positions stay exact
+        angle   fraction of a full turn
+        id      block id
+
+    Positions and angles are rounded to the nearest step. Blocks that do
+    not fit at all (outside their chunk, id over 65535) are also kept as a
+    Block and put back in their place when decoded. With keepExact every
+    block that would not come back bit for bit is kept like that too, which
+    is most blocks of a hand made map. Blocks are decoded to Block only when
+    read. Only the chunks that have blocks take memory.
+ */
+
+class CompactBlocks
+{
+public:
+    void build(const MapFile& info, const Block *blocks, unsigned int count, int chunkSize, bool keepExact = false);
+    // Whole map from the file, read a chunk at a time.
+    void load(const MapReader& reader, int chunkSize, bool keepExact = false);
+    void clear();
+
+    const MapFile& getInfo() const { return info; }
+    const GridLayout& getLayout() const { return layout; }
+    unsigned int getBlockCount() const { return id.size(); }
+    unsigned int getChunkBlockCount(int chunk) const;
+
+    // Appends the decoded blocks of the chunk to result, in the order they were given.
+    void decodeChunk(int chunk, std::vector<Block>& result) const;
+    // Appends the blocks centered within margin of area.
+    void queryArea(const BlockBounds& area, float margin, std::vector<Block>& result) const;
+
+    size_t getMemoryUsage() const;
+    unsigned int getExactCount() const { return exact.size(); }    // Blocks that did not fit the arrays
+
+private:
+    template <class ForEachBlock>
+    void build(const MapFile& info, int chunkSize, bool keepExact, ForEachBlock forEachBlock);
+
+    bool encode(const Block& block, int chunk, uint16_t *result) const;
+    // Place of chunk in chunks, -1 when it has no blocks.
+    int findChunk(int chunk) const;
+    void decodeEntry(int entry, std::vector<Block>& result) const;
+    float getOriginX(int chunk) const { return (chunk % layout.getColumns()) * (float)layout.getCellSize(); }
+    float getOriginY(int chunk) const { return (chunk / layout.getColumns()) * (float)layout.getCellSize(); }
+
+    MapFile info = {0, 0, "", ""};
+    GridLayout layout;
+    float step = 1.0f;
+    bool keepExact = false;
+
+    std::vector <int> chunks;               // Chunks that have blocks, in order
+    std::vector <uint32_t> chunkStart;      // First block of each of chunks, one extra at the end
+    std::vector <uint16_t> x, y, angle, id;
+
+    std::vector <uint32_t> exactAt;         // Sorted places of the blocks in exact
+    std::vector <Block> exact;
+};
@@ -46,6 +46,11 @@ void Console::init(class Resources *res)
     addCommand("new", std::bind(&Console::newCommand, this, std::placeholders::_1));    
     addCommand("load", std::bind(&Console::loadCommand, this, std::placeholders::_1));    
     addCommand("setangle", std::bind(&Console::setAngle, this, std::placeholders::_1));    
+    addCommand("pagebudget", std::bind(&Console::pageBudgetCommand, this, std::placeholders::_1));
+    addCommand("texturebudget", std::bind(&Console::textureBudgetCommand, this, std::placeholders::_1));
+    addCommand("textures", std::bind(&Console::texturesCommand, this, std::placeholders::_1));
+    addCommand("stamp", std::bind(&Console::stampCommand, this, std::placeholders::_1));
+    addCommand("tile", std::bind(&Console::tileCommand, this, std::placeholders::_1));
 }
 
 void Console::updateLogBufferPosition()
@@ -229,6 +234,13 @@ void Console::helpCommand(std::vector <std::string> args)
     addLogLine("\tCommand\t\tArguments\t\t\t\t\t\tDescription");
     addLogLine("\t   help\t\t-\t\tThis help");
     addLogLine("\t   new\t\t[width] [height]\t\tCreates new map");
+    addLogLine("\t   load\t\t[name] [paged|view]\tLoads a map, paged keeps only chunks near the camera in memory, view is read only");
+    addLogLine("\t   pagebudget\t[megabytes]\t\tMemory for the blocks of a paged map");
+    addLogLine("\t   texturebudget\t[megabytes]\t\tMemory for loaded block textures and atlas pages");
+    addLogLine("\t   textures\t-\t\tLoaded and evicted block textures and atlas pages");
+    addLogLine("\t   stamp\t\t[save|use|delete] [name]\tSelection as a named stamp, use puts it to the clipboard");
+    addLogLine("\t   stamp\t\tlist\t\t\tAll stamps");
+    addLogLine("\t   tile\t\t[x] [y] [width] [height] [angle]\tClipboard copies side by side over the area");
     
 }
 
@@ -240,10 +252,15 @@ void Console::newCommand(std::vector <std::string> args)
     }
     else
     {
-        if ( resources->getMap()->isSaved() )
+        int width = std::stoi(args[1]);
+        int height = std::stoi(args[2]);
+
+        if ( width <= 0 || height <= 0 || width > maxMapSize || height > maxMapSize )
+            addLogLine("\tError: Width and height go from 1 to " + std::to_string(maxMapSize) + ".");
+        else if ( resources->getMap()->isSaved() )
         {
             addLogLine("Creating new " + args[1] + "x" + args[2] + " map.");
-            resources->getMap()->createNew("Filename", std::stoi(args[1]), std::stoi(args[2]), "Name", "Author");
+            resources->getMap()->createNew("Filename", width, height, "Name", "Author");
         } else
         {
             addLogLine("Map havent been saved, please use (new [width] [height] nosave) to proceed without saving.");
@@ -254,13 +271,18 @@ void Console::newCommand(std::vector <std::string> args)
 
 void Console::loadCommand(std::vector <std::string> args)
 {
-    if (args.size() == 2)
+    if (args.size() == 2 || (args.size() == 3 && (args[2] == "paged" || args[2] == "view")))
     {
         bool returnCode = false;
-        if ( args[1].find(".map") == std::string::npos )
-            returnCode = resources->getMap()->loadMap(args[1] + ".map");
+        bool paged = args.size() == 3 && args[2] == "paged";
+        std::string name = args[1];
+        if ( name.find(".map") == std::string::npos )
+            name += ".map";
+
+        if ( args.size() == 3 && args[2] == "view" )
+            returnCode = resources->getMap()->viewMap(name);
         else
-            returnCode = resources->getMap()->loadMap(args[1]);
+            returnCode = resources->getMap()->loadMap(name, paged);
         
         if ( !returnCode )
         {
@@ -271,7 +293,7 @@ void Console::loadCommand(std::vector <std::string> args)
 
     } else
     {
-        addLogLine("\tWrong number of arguments.");
+        addLogLine("\tWrong number of arguments. (load [name] [paged|view])");
         addLogLine("All maps that you can load:");
         for(auto& p: fs::directory_iterator("."))
         {
@@ -301,3 +323,109 @@ void Console::setAngle(std::vector <std::string> args)
     }
 
 }
+
+void Console::pageBudgetCommand(std::vector <std::string> args)
+{
+    if ( args.size() != 2 )
+    {
+        addLogLine("\tWrong number of arguments. (pagebudget megabytes)");
+        return;
+    }
+
+    int megabytes = std::atoi(args[1].c_str());
+    if ( megabytes <= 0 )
+    {
+        addLogLine("\tPage budget has to be over 0 MB.");
+        return;
+    }
+
+    resources->getMap()->setPageBudget((size_t)megabytes * 1024 * 1024);
+    addLogLine("Page budget set to " + std::to_string(megabytes) + " MB.");
+}
+
+void Console::textureBudgetCommand(std::vector <std::string> args)
+{
+    if ( args.size() != 2 )
+    {
+        addLogLine("\tWrong number of arguments. (texturebudget megabytes)");
+        return;
+    }
+
+    int megabytes = std::atoi(args[1].c_str());
+    if ( megabytes <= 0 )
+    {
+        addLogLine("\tTexture budget has to be over 0 MB.");
+        return;
+    }
+
+    resources->setTextureBudget((size_t)megabytes * 1024 * 1024);
+    addLogLine("Texture budget set to " + std::to_string(megabytes) + " MB.");
+}
+
+void Console::texturesCommand(std::vector <std::string> args)
+{
+    resources->logTextureStats();
+}
+
+void Console::stampCommand(std::vector <std::string> args)
+{
+    Map *map = resources->getMap();
+
+    if ( args.size() == 2 && args[1] == "list" )
+    {
+        std::vector <std::string> names;
+        map->getStampNames(names);
+
+        addLogLine("Stamps:");
+        for ( const auto& name : names )
+            addLogLine("\t-> " + name);
+    }
+    else if ( args.size() == 3 && args[1] == "save" )
+    {
+        if ( map->saveStamp(args[2]) )
+            addLogLine("Stamp " + args[2] + " saved.");
+        else
+            addLogLine("\tError: Nothing is selected.");
+    }
+    else if ( args.size() == 3 && args[1] == "use" )
+    {
+        if ( map->useStamp(args[2]) )
+            addLogLine("Stamp " + args[2] + " is in the clipboard, paste it with ctrl+v.");
+        else
+            addLogLine("\tError: No stamp " + args[2] + ".");
+    }
+    else if ( args.size() == 3 && args[1] == "delete" )
+    {
+        if ( map->removeStamp(args[2]) )
+            addLogLine("Stamp " + args[2] + " deleted.");
+        else
+            addLogLine("\tError: No stamp " + args[2] + ".");
+    }
+    else
+        addLogLine("\tWrong arguments. (stamp [save|use|delete] [name]) or (stamp list)");
+}
+
+void Console::tileCommand(std::vector <std::string> args)
+{
+    if ( args.size() != 5 && args.size() != 6 )
+    {
+        addLogLine("\tWrong number of arguments. (tile x y width height [angle])");
+        return;
+    }
+
+    float x = std::atof(args[1].c_str());
+    float y = std::atof(args[2].c_str());
+    float width = std::atof(args[3].c_str());
+    float height = std::atof(args[4].c_str());
+    float angle = args.size() == 6 ? std::atof(args[5].c_str()) : 0.0f;
+
+    BlockBounds area = {x, y, x + width, y + height};
+    if ( resources->getMap()->getTileBlockCount(area, angle) > maxTileBlocks )
+    {
+        addLogLine("\tError: The area would take over " + std::to_string(maxTileBlocks) + " blocks, tile a smaller one.");
+        return;
+    }
+
+    if ( !resources->getMap()->tile(area, angle) )
+        addLogLine("\tNothing was tiled, copy blocks first and check the area.");
+}
@@ -28,6 +28,11 @@ public:
     void newCommand(std::vector <std::string> args);
     void loadCommand(std::vector <std::string> args);
     void setAngle(std::vector <std::string> args);
+    void pageBudgetCommand(std::vector <std::string> args);
+    void textureBudgetCommand(std::vector <std::string> args);
+    void texturesCommand(std::vector <std::string> args);
+    void stampCommand(std::vector <std::string> args);
+    void tileCommand(std::vector <std::string> args);
     
     std::vector <std::string>getArgs(std::string);
 
@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+#include "BlockBounds.hpp"
+
+// Splits a width*height map to square cells. Positions outside the map
+// go to the nearest edge cell, there is one extra column and row for
+// positions exactly on the right and bottom edge.
+struct GridLayout
+{
+    int columns = 0;
+    int rows = 0;
+    int cellSize = 1;
+
+    void create(int width, int height, int size)
+    {
+        cellSize = size > 0 ? size : 1;
+        columns  = std::max(width, 0) / cellSize + 1;
+        rows     = std::max(height, 0) / cellSize + 1;
+    }
+
+    // Clamped as float first, so huge coordinates don't overflow the int.
+    int getCellX(float x) const
+    {
+        float cellX = x / cellSize;
+        return cellX <= 0.0f ? 0 : (cellX >= columns-1 ? columns-1 : (int)cellX);
+    }
+
+    int getCellY(float y) const
+    {
+        float cellY = y / cellSize;
+        return cellY <= 0.0f ? 0 : (cellY >= rows-1 ? rows-1 : (int)cellY);
+    }
+
+    int getCell(float x, float y) const { return getCellY(y) * columns + getCellX(x); }
+
+    // Area of positions that go to the cell, edge cells reach outside the map.
+    BlockBounds getCellArea(int cell) const
+    {
+        int cellX = cell % columns;
+        int cellY = cell / columns;
+        BlockBounds area = {(float)cellX * cellSize, (float)cellY * cellSize,
+                            (float)(cellX+1) * cellSize, (float)(cellY+1) * cellSize};
+
+        const float outside = std::numeric_limits<float>::max();
+        if ( cellX == 0 )          area.left = -outside;
+        if ( cellY == 0 )          area.top = -outside;
+        if ( cellX == columns-1 )  area.right = outside;
+        if ( cellY == rows-1 )     area.bottom = outside;
+
+        return area;
+    }
+    int64_t getCellCount() const { return (int64_t)columns * rows; }
+
+    int getColumns() const { return columns; }
+    int getRows() const { return rows; }
+    int getCellSize() const { return cellSize; }
+};
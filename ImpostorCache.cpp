@@ -0,0 +1,119 @@
+#include "ImpostorCache.hpp"
+#include "ChunkRenderer.hpp"
+
+const int slotsPerSide = impostorPageSize / impostorSize;
+const int slotsPerPage = slotsPerSide * slotsPerSide;
+
+ImpostorCache::~ImpostorCache()
+{
+    for ( auto *page : pages )
+        delete page;
+}
+
+void ImpostorCache::create(int chunkCount)
+{
+    clear();
+    impostors.assign(chunkCount, Impostor());
+}
+
+void ImpostorCache::clear()
+{
+    // Pages are kept, render textures are slow to create.
+    impostors.clear();
+    usedSlots = 0;
+
+    for ( auto& quads : pageQuads )
+        quads.clear();
+}
+
+sf::FloatRect ImpostorCache::getSlotRect(int slot) const
+{
+    int slotInPage = slot % slotsPerPage;
+
+    return sf::FloatRect((float)(slotInPage % slotsPerSide) * impostorSize,
+                         (float)(slotInPage / slotsPerSide) * impostorSize,
+                         (float)impostorSize, (float)impostorSize);
+}
+
+void ImpostorCache::add(int chunk, ChunkRenderer& chunks, Resources *res)
+{
+    const BlockBounds& bounds = chunks.getBounds(chunk);
+    if ( bounds.isEmpty() )
+        return;
+
+    Impostor& impostor = impostors[chunk];
+
+    if ( impostor.slot == -1 )
+    {
+        impostor.slot = usedSlots++;
+
+        if ( impostor.slot / slotsPerPage >= (int)pages.size() )
+        {
+            sf::RenderTexture *page = new sf::RenderTexture();
+            page->create(impostorPageSize, impostorPageSize);
+            page->setSmooth(true);
+            page->clear(sf::Color::Transparent);
+
+            pages.push_back(page);
+            pageQuads.push_back(sf::VertexArray(sf::Quads));
+            pageBaked.push_back(true);
+        }
+
+        bake(chunk, impostor.slot, chunks, res);
+    }
+    else if ( impostor.version != chunks.getVersion(chunk) )
+        bake(chunk, impostor.slot, chunks, res);
+
+    // Half texel inset so the neighbour slots don't bleed in.
+    sf::FloatRect slotRect = getSlotRect(impostor.slot);
+    float left   = slotRect.left + 0.5f;
+    float top    = slotRect.top + 0.5f;
+    float right  = slotRect.left + slotRect.width - 0.5f;
+    float bottom = slotRect.top + slotRect.height - 0.5f;
+
+    sf::VertexArray& quads = pageQuads[impostor.slot / slotsPerPage];
+    quads.append(sf::Vertex({bounds.left,  bounds.top},    {left,  top}));
+    quads.append(sf::Vertex({bounds.right, bounds.top},    {right, top}));
+    quads.append(sf::Vertex({bounds.right, bounds.bottom}, {right, bottom}));
+    quads.append(sf::Vertex({bounds.left,  bounds.bottom}, {left,  bottom}));
+}
+
+void ImpostorCache::bake(int chunk, int slot, ChunkRenderer& chunks, Resources *res)
+{
+    const BlockBounds& bounds = chunks.getBounds(chunk);
+    sf::RenderTexture *page = pages[slot / slotsPerPage];
+    sf::FloatRect slotRect = getSlotRect(slot);
+
+    sf::View view(sf::FloatRect(bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top));
+    view.setViewport(sf::FloatRect(slotRect.left / impostorPageSize, slotRect.top / impostorPageSize,
+                                   slotRect.width / impostorPageSize, slotRect.height / impostorPageSize));
+    page->setView(view);
+
+    // Wipe the old picture of the slot.
+    sf::RectangleShape background({bounds.right - bounds.left, bounds.bottom - bounds.top});
+    background.setPosition(bounds.left, bounds.top);
+    background.setFillColor(sf::Color::Transparent);
+    page->draw(background, sf::RenderStates(sf::BlendNone));
+
+    chunks.draw(*page, chunk, res);
+
+    impostors[chunk].version = chunks.getVersion(chunk);
+    pageBaked[slot / slotsPerPage] = true;
+}
+
+void ImpostorCache::draw(sf::RenderTarget& target)
+{
+    for ( unsigned int page = 0; page < pages.size(); page++ )
+    {
+        if ( pageBaked[page] )
+        {
+            pages[page]->display();
+            pageBaked[page] = false;
+        }
+
+        if ( pageQuads[page].getVertexCount() > 0 )
+            target.draw(pageQuads[page], &pages[page]->getTexture());
+
+        pageQuads[page].clear();
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+#include "SpatialIndex.hpp"
+
+const unsigned int impostorSize = 128;          // Pixels per side of one baked chunk
+const unsigned int impostorPageSize = 2048;     // Pixels per side of one impostor page
+
+/*
+    Low resolution pictures of chunks for zoomed out views.
+
+    Every chunk that has been seen zoomed out gets a slot on an impostor page
+    (a big sf::RenderTexture) and its geometry is drawn there once. The slot
+    is baked again only when the chunk geometry version changes. All
+    impostors of one page are drawn with one vertex array.
+ */
+
+class ImpostorCache
+{
+public:
+    ~ImpostorCache();
+
+    void create(int chunkCount);
+    void clear();
+
+    // Texels per map unit for a chunk of chunkSize units.
+    static float getDetail(int chunkSize) { return (float)impostorSize / chunkSize; }
+
+    // Bakes the chunk if needed and queues it to be drawn.
+    void add(int chunk, class ChunkRenderer& chunks, class Resources *res);
+    void draw(sf::RenderTarget& target);
+
+private:
+    struct Impostor
+    {
+        int slot = -1;
+        unsigned int version = 0;
+    };
+
+    void bake(int chunk, int slot, class ChunkRenderer& chunks, class Resources *res);
+    sf::FloatRect getSlotRect(int slot) const;
+
+    std::vector <Impostor> impostors;           // By chunk
+    std::vector <sf::RenderTexture *> pages;
+    std::vector <sf::VertexArray> pageQuads;    // Impostors to draw on this frame
+    std::vector <bool> pageBaked;               // Page needs display() before drawing
+
+    int usedSlots = 0;
+};
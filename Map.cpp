@@ -1,7 +1,6 @@
 #include "Map.hpp"
 #include "Resources.hpp"
 #include <iostream>
-#include <fstream>
 
 #include <string>
 #include <cstring>
@@ -9,127 +8,292 @@
 
 #include "Utils.hpp"
 #include "Console.hpp"
+#include "AtomicWrite.hpp"
+#include <algorithm>
 
-#ifdef linux
-#include <filesystem>
-namespace fs = std::filesystem;
-#endif
-
-#if defined(_WIN32) || defined(_WIN64)
-#include <experimental/filesystem>
-namespace fs = std::experimental::filesystem;
-#endif
+static BlockBounds getCameraArea(const sf::View& camera)
+{
+    BlockBounds area;
+    area.left   = camera.getCenter().x - camera.getSize().x / 2.0f;
+    area.top    = camera.getCenter().y - camera.getSize().y / 2.0f;
+    area.right  = camera.getCenter().x + camera.getSize().x / 2.0f;
+    area.bottom = camera.getCenter().y + camera.getSize().y / 2.0f;
 
-const int mapID = 0x2150614D;
+    return area;
+}
 
 Map::~Map()
 {
+    // The console can be gone already, nothing is logged from here on.
+    res = nullptr;
     clear();
 }
 
 bool Map::saveMap()
 {
-    std::fstream mapFile;
-    if(fs::exists(filename))
-        fs::copy(filename, filename+".bak");
+    Console *console = res->getConsole();
 
-    mapFile.open(filename, std::ios::out | std::ios::binary);
-    if(mapFile.is_open())
+    if ( refuseViewOnly() )
+        return false;
+
+    if ( saver.isRunning() )
     {
-        char nameLength = info.name.length();
-        char authorLength = info.author.length();
-        int blockCount = blocks.size();
+        if ( console )
+            console->addLogLine("Save to " + saver.getFilename() + " is still running.");
+        return false;
+    }
+
+    if ( pager.isOpen() )
+    {
+        bool result = savePaged();
+        if ( console )
+            console->addLogLine(result ? "Map saved to " + filename + "." : "Error: Can't save the map to " + filename + ".");
+        return result;
+    }
+
+    if ( !startSave(filename, false) )
+        return false;
 
-        mapFile.write((const char *)&mapID,             4); // MaP!
-        mapFile.write((const char *)&info.width,        4); // Width
-        mapFile.write((const char *)&info.height,       4); // Height
-        mapFile.write(&nameLength,                      1); // Name length
-        mapFile.write(&authorLength,                    1); // Author name length
+    if ( console )
+        console->addLogLine("Saving " + std::to_string(blocks.size()) + " blocks to " + filename + "...");
+    return true;
+}
 
-        mapFile.write(info.name.c_str(),                nameLength);    // Map name
-        mapFile.write(info.author.c_str(),              authorLength);  // Author name
+bool Map::startSave(const std::string& target, bool compact)
+{
+    // Snapshot of the blocks, edits after this go to the next save.
+    std::vector <Block> snapshot(blocks.begin(), blocks.end());
+    std::vector <BlockBounds> bounds(blocks.size());
 
-        mapFile.write((const char *)&blockCount,        4); // Block count
+    for ( unsigned int c = 0; c < blocks.size(); c++ )
+        bounds[c] = spatialIndex.getBounds(blocks.getHandle(c).index);
 
-        for( auto* block : blocks )
-        {
-            mapFile.write((const char *)&block->x,       4);
-            mapFile.write((const char *)&block->y,       4);
-            mapFile.write((const char *)&block->angle,   4);
-            mapFile.write((const char *)&block->id,      4);
-        }
-        
-        mapFile.close();
+    // A compaction saves only what is already in the map file and the journal.
+    savingEditCount = compact ? savedEditCount : editCount;
+    savingJournalRecords = journal.getRecordCount();
+    reportedProgress = 0;
+
+    return saver.start(target, info, std::move(snapshot), std::move(bounds), gridSize);
+}
+
+void Map::updateSave()
+{
+    if ( !saver.isRunning() )
+        return;
+
+    Console *console = res->getConsole();
+
+    if ( !saver.isFinished() )
+    {
+        int progress = saver.getProgress() / 25 * 25;
+        if ( progress > reportedProgress && progress < 100 && console )
+            console->addLogLine("\tSaving... " + std::to_string(progress) + "%");
+        reportedProgress = std::max(reportedProgress, progress);
+        return;
+    }
+
+    finishSave();
+}
+
+bool Map::finishSave()
+{
+    Console *console = res ? res->getConsole() : nullptr;
+
+    std::string savedFilename = saver.getFilename();
+    bool result = saver.finish();
+
+    if ( result )
+    {
+        savedEditCount = savingEditCount;
+
+        // Edits made during the save are moved to the journal of the new file.
+        if ( !journal.restart(savedFilename + ".journal", saver.getFileHash(), savingJournalRecords) && console )
+            console->addLogLine("Error: Can't write the journal of " + savedFilename + ".");
+        nextCompaction = journalCompactRecords;
     }
     else
-        return false;
-    
-    saved = true;
-    return true;
+        nextCompaction = journal.getRecordCount() + journalCompactRecords;
+
+    if ( console )
+        console->addLogLine(result ? "Map saved to " + savedFilename + "." : "Error: Can't save the map to " + savedFilename + ".");
+
+    return result;
 }
 
-bool Map::loadMap(std::string filename)
+void Map::updateSort()
 {
-    char readBuffer[256] = {};
-    std::fstream mapFile;
+    if ( sorter.isRunning() )
+    {
+        if ( !sorter.isFinished() )
+            return;
+
+        // After edits during the sort the order is thrown away and made again.
+        bool changed = sorter.finish();
+        bool applied = sorter.apply(blocks);
+        if ( applied || !changed )
+            sortedChangeCount = blocks.getChangeCount();
+        return;
+    }
 
-    mapFile.open(filename, std::ios::in | std::ios::binary);
-    if(mapFile.is_open())
+    // Added blocks go to the end and removes move the last block to the hole, the
+    // order is sorted again on a background thread once enough has changed.
+    if ( blocks.getChangeCount() - sortedChangeCount >= std::max<uint64_t>(resortChanges, blocks.size() / 8) )
+        sorter.start(blockOrder, blocks);
+}
+
+void Map::update(sf::View& camera)
+{
+    updateSave();
+    updateSort();
+
+    // Folds a long journal back to the map file it belongs to.
+    if ( journal.getRecordCount() >= nextCompaction && !saver.isRunning() )
     {
-        char nameLength = 0;
-        char authorLength = 0;
-        int blockCount = 0;
-        int readedMapID = 0;
+        std::string target = journal.getFilename().substr(0, journal.getFilename().size() - std::string(".journal").size());
+        if ( startSave(target, true) && res->getConsole() )
+            res->getConsole()->addLogLine("Compacting the journal to " + target + "...");
+    }
 
-        mapFile.read((char *)&readedMapID,              4); // File ID
-        if ( readedMapID != mapID )
+    updatePaging(camera);
+}
+
+bool Map::loadMap(std::string filename, bool paged)
+{
+    MapReader mapFile;
+    uint64_t mapHash = 0;
+
+    // Whole header is checked before anything of the old map is touched.
+    if ( !mapFile.open(filename) )
+        return false;
+
+    clear();
+
+    // Only v2 files have chunks to page, v1 files are always loaded whole.
+    bool usePager = paged && mapFile.getVersion() == 2;
+    if ( usePager )
+    {
+        if ( !pager.open(filename) )
         {
-            mapFile.close();
+            mapReady = false;
             return false;
         }
 
-        clear();
+        // Map chunks have to be the file chunks.
+        gridSize = pager.getLayout().getCellSize();
+    }
 
-        mapFile.read((char *)&info.width,               4); // Width
-        mapFile.read((char *)&info.height,              4); // Height
-        mapFile.read((char *)&nameLength,               1); // Name length
-        mapFile.read((char *)&authorLength,             1); // Author name length
-    
-        mapFile.read(readBuffer,                nameLength);    // Name
-        readBuffer[nameLength] = 0;
-        info.name = readBuffer;
+    create(mapFile.getInfo(), gridSize);
 
-        mapFile.read(readBuffer,              authorLength);  // Author name
-        readBuffer[authorLength] = 0;
-        info.author = readBuffer;
+    if ( !usePager )
+    {
+        // Block data is stored exactly like Block and all chunks are back to back,
+        // so every version is copied with one go.
+        blocks.assign(mapFile.getBlockData(), mapFile.getBlockCount());
+        mapHash = hashMapFile(mapFile.getFileData(), mapFile.getFileSize());
+        orderBlocks();
+    }
 
-        mapFile.read((char *)&blockCount,        4); // Block count
+    chunks.create(info.width, info.height, gridSize);
+    impostors.create(chunks.getChunkCount());
+    chunkWanted.assign(chunks.getChunkCount(), false);
+    rebuildIndex();
 
-        for( unsigned int c = 0; c < blockCount; c++ )
-        {
-            Block *blockPointer = new Block;
+    this->filename = filename.substr(0, filename.find_last_of('.'));
+    savedEditCount = editCount;
+    mapReady = true;
 
-            mapFile.read((char *)&blockPointer->x,       4);
-            mapFile.read((char *)&blockPointer->y,       4);
-            mapFile.read((char *)&blockPointer->angle,   4);
-            mapFile.read((char *)&blockPointer->id,      4);
+    if ( !pager.isOpen() )
+        replayJournal(filename + ".journal", mapHash);
 
-            blocks.push_back(blockPointer);
-            blockGrid[getGridNumber(blockPointer->x, blockPointer->y)].emplace_back(blockPointer);
+    return true;
+}
 
+bool Map::viewMap(std::string filename)
+{
+    MapReader mapFile;
+    if ( !mapFile.open(filename) )
+        return false;
+
+    clear();
+    create(mapFile.getInfo(), gridSize);
+    viewBlocks.load(mapFile, gridSize);
+
+    // Camera queries go by block centers, they have to reach as far as the biggest block.
+    viewMargin = 0.0f;
+    for ( int chunk = 0; chunk < viewBlocks.getLayout().getCellCount(); chunk++ )
+    {
+        if ( viewBlocks.getChunkBlockCount(chunk) == 0 )
+            continue;
+
+        viewBuffer.clear();
+        viewBlocks.decodeChunk(chunk, viewBuffer);
+
+        for ( const Block& block : viewBuffer )
+        {
+            BlockBounds bounds = getBlockBounds(block);
+            viewMargin = std::fmax(viewMargin, std::fmax(bounds.right - block.x, bounds.bottom - block.y));
         }
-        
-        mapFile.close();
     }
-    else
-        return false;
-    
+
     this->filename = filename.substr(0, filename.find_last_of('.'));
-    saved = true;
+    savedEditCount = editCount;
+    viewOnly = true;
     mapReady = true;
+
     return true;
 }
 
+bool Map::refuseViewOnly()
+{
+    if ( !viewOnly )
+        return false;
+
+    if ( res && res->getConsole() )
+        res->getConsole()->addLogLine("Error: The map is only viewed, load it again to edit it.");
+    return true;
+}
+
+void Map::replayJournal(const std::string& journalName, uint64_t mapHash)
+{
+    std::vector <MapJournal::Record> records;
+
+    // Edits that were not saved before the map was closed, or the editor crashed.
+    if ( MapJournal::read(journalName, mapHash, records) )
+    {
+        for ( const auto& record : records )
+        {
+            if ( record.operation == MapJournal::Add )
+                insertBlock(record.block);
+            else if ( record.operation == MapJournal::Remove )
+                removeBlockAt(record.block);
+        }
+
+        if ( !records.empty() )
+        {
+            editCount++;
+            if ( res->getConsole() )
+                res->getConsole()->addLogLine("Replayed " + std::to_string(records.size()) + " edits from " + journalName + ".");
+        }
+    }
+
+    journal.open(journalName, mapHash);
+}
+
+void Map::removeBlockAt(const Block& block)
+{
+    queryBuffer.clear();
+    spatialIndex.query({block.x, block.y, block.x, block.y}, queryBuffer);
+
+    for ( uint32_t slot : queryBuffer )
+    {
+        if ( std::memcmp(&blocks.getBySlot(slot), &block, sizeof(Block)) == 0 )
+        {
+            removeBlock(blocks.getHandleBySlot(slot));
+            return;
+        }
+    }
+}
+
 void Map::clear()
 {
     info.name       = "";
@@ -137,49 +301,300 @@ void Map::clear()
     info.width      = 0;
     info.height     = 0;
 
-    
-    for(auto *i : blocks)
-        if ( i )
-            delete i;
-    
+    // A running save is written out before anything else happens to the map,
+    // so the edits made during it are in the journal of the saved file.
+    if ( saver.isRunning() )
+        finishSave();
+
+    unselect();
+    pager.close();
+    journal.close();
+    gridSize = defaultGridSize;
+    wantedChunks.clear();
+    chunkWanted.clear();
+
+    sorter.clear();
+
     blocks.clear();
-    blockGrid.clear();
+    sortedChangeCount = blocks.getChangeCount();
+    spatialIndex.clear();
+    chunks.clear();
+    impostors.clear();
+    blockSizes.clear();
+
+    viewOnly = false;
+    viewBlocks.clear();
+    viewBuffer = std::vector<Block>();
 }
 
-std::vector <Block *> Map::getBlocksOnCamera(sf::View& camera)
+bool Map::savePaged()
 {
-    std::vector <Block *> result;
+    // Resident blocks by chunk, the rest comes from the pager chunk by chunk.
+    std::vector <std::pair<int, uint32_t>> residentOrder(blocks.size());
 
-    if ( blocks.empty() )
-        return result;
+    for ( unsigned int c = 0; c < blocks.size(); c++ )
+        residentOrder[c] = {chunks.getChunk(blocks[c].x, blocks[c].y), c};
+    std::sort(residentOrder.begin(), residentOrder.end());
+
+    std::vector <MapChunkEntry> directory;
+    unsigned int next = 0;
+
+    for ( int chunk = 0; chunk < chunks.getChunkCount(); chunk++ )
+    {
+        if ( pager.getState(chunk) != MapPager::Resident )
+        {
+            if ( pager.getBlockCount(chunk) > 0 )
+                directory.push_back({chunk, pager.getBlockCount(chunk), 0, pager.getBounds(chunk)});
+            continue;
+        }
 
-    int lastIndex = blockGrid.rbegin()->first;
+        MapChunkEntry entry = {chunk, 0, 0, BlockBounds()};
+        for ( ; next < residentOrder.size() && residentOrder[next].first == chunk; next++ )
+        {
+            entry.bounds.add(spatialIndex.getBounds(blocks.getHandle(residentOrder[next].second).index));
+            entry.blockCount++;
+        }
 
-    int halfSizeX = camera.getSize().x / 2.0f;
-    int halfSizeY = camera.getSize().y / 2.0f;
+        if ( entry.blockCount > 0 )
+            directory.push_back(entry);
+    }
+
+    std::vector <char> header = writeMapV2Header(info, pager.getLayout(), directory);
 
-    int xStartPositionIndex = getGridX(camera.getCenter().x - halfSizeX);
-    int xEndPositionIndex   = getGridX(camera.getCenter().x + halfSizeX);
-    
-    int yStartPositionIndex = getGridY(camera.getCenter().y - halfSizeY);
-    int yEndPositionIndex   = getGridY(camera.getCenter().y + halfSizeY);
+    AtomicFileWriter writer;
+    if ( !writer.open(filename) || !writer.write(header.data(), header.size()) )
+        return false;
 
-    for ( int y = yStartPositionIndex; y <= yEndPositionIndex; y++ )
+    next = 0;
+    for ( const auto& entry : directory )
     {
-        for ( int x = xStartPositionIndex; x <= xEndPositionIndex; x++)
-        {
-            int index = y*(info.width/gridSize)+x;
-            if ( index > lastIndex )
-                break;
+        pageBuffer.clear();
 
-            if ( blockGrid.find(index) != blockGrid.end() )
-                result.insert(std::end(result), std::begin(blockGrid[index]), std::end(blockGrid[index]));
+        if ( pager.getState(entry.chunk) == MapPager::Resident )
+        {
+            while ( next < residentOrder.size() && residentOrder[next].first < entry.chunk )
+                next++;
+            for ( ; next < residentOrder.size() && residentOrder[next].first == entry.chunk; next++ )
+                pageBuffer.push_back(blocks[residentOrder[next].second]);
         }
+        else
+            pager.readChunk(entry.chunk, pageBuffer);
+
+        sortBlocks(blockOrder, pageBuffer);
+
+        if ( pageBuffer.size() != (unsigned int)entry.blockCount ||
+             !writer.write(pageBuffer.data(), pageBuffer.size() * sizeof(Block)) )
+            return false;
+    }
+
+    if ( !writer.commit(true) )
+        return false;
+
+    // Edited chunks that were paged out are in the new file now.
+    pager.reopen(filename);
+
+    savedEditCount = editCount;
+    return true;
+}
+
+void Map::updatePaging(sf::View& camera)
+{
+    if ( !pager.isOpen() )
+        return;
+
+    // Requests that have not started are made again in the new order.
+    pager.clearRequests();
+
+    MapPager::LoadedChunk loaded;
+    while ( pager.takeLoaded(loaded) )
+        for ( const auto& block : loaded.blocks )
+            insertBlock(block);
+
+    const GridLayout& layout = pager.getLayout();
+    sf::Vector2f center = camera.getCenter();
+
+    auto getDistance = [&layout, center](int chunk) {
+        float x = (chunk % layout.getColumns() + 0.5f) * layout.getCellSize() - center.x;
+        float y = (chunk / layout.getColumns() + 0.5f) * layout.getCellSize() - center.y;
+        return x*x + y*y;
+    };
+
+    for ( int chunk : wantedChunks )
+        chunkWanted[chunk] = false;
+    wantedChunks.clear();
+
+    // Chunks on the camera and one more around it, blocks overhang their chunk.
+    BlockBounds area = getCameraArea(camera);
+
+    for ( int y = layout.getCellY(area.top - gridSize); y <= layout.getCellY(area.bottom + gridSize); y++ )
+        for ( int x = layout.getCellX(area.left - gridSize); x <= layout.getCellX(area.right + gridSize); x++ )
+            wantedChunks.push_back(y * layout.getColumns() + x);
+
+    std::sort(wantedChunks.begin(), wantedChunks.end(), [&getDistance](int a, int b) {
+        return getDistance(a) < getDistance(b);
+    });
+
+    // Nearest chunks first, as many as fit in the budget.
+    size_t maxBlocks = pageBudget / residentBlockBytes;
+    size_t wantedBlocks = 0;
+    unsigned int wantedCount = 0;
+
+    for ( ; wantedCount < wantedChunks.size(); wantedCount++ )
+    {
+        int chunk = wantedChunks[wantedCount];
+
+        wantedBlocks += pager.getBlockCount(chunk);
+        if ( wantedBlocks > maxBlocks && wantedCount > 0 )
+            break;
+
+        chunkWanted[chunk] = true;
+        pager.request(chunk);
+    }
+    wantedChunks.resize(wantedCount);
+
+    if ( blocks.size() <= maxBlocks )
+        return;
+
+    // Farthest chunks out first.
+    std::vector <int> evictable;
+    for ( int chunk : pager.getResidentChunks() )
+        if ( !chunkWanted[chunk] )
+            evictable.push_back(chunk);
+
+    std::sort(evictable.begin(), evictable.end(), [&getDistance](int a, int b) {
+        return getDistance(a) > getDistance(b);
+    });
+
+    for ( int chunk : evictable )
+    {
+        if ( blocks.size() <= maxBlocks )
+            break;
+        evictChunk(chunk);
+    }
+}
+
+void Map::getChunkBlocks(int chunk, std::vector<uint32_t>& result)
+{
+    result.clear();
+    spatialIndex.query(chunks.getChunkArea(chunk), result);
+
+    // Blocks of the neighbours overhang to the chunk area.
+    result.erase(std::remove_if(result.begin(), result.end(), [this, chunk](uint32_t slot) {
+        const Block& block = blocks.getBySlot(slot);
+        return chunks.getChunk(block.x, block.y) != chunk;
+    }), result.end());
+}
+
+void Map::makeResident(int chunk)
+{
+    if ( pager.getState(chunk) == MapPager::Resident )
+        return;
+
+    pageBuffer.clear();
+    pager.load(chunk, pageBuffer);
+
+    for ( const auto& block : pageBuffer )
+        insertBlock(block);
+}
+
+bool Map::evictChunk(int chunk)
+{
+    BlockBounds bounds;
+
+    getChunkBlocks(chunk, chunkSlots);
+    pageBuffer.clear();
+
+    for ( uint32_t slot : chunkSlots )
+    {
+        pageBuffer.push_back(blocks.getBySlot(slot));
+        bounds.add(spatialIndex.getBounds(slot));
     }
+
+    // Stays resident when the edits could not be written.
+    if ( !pager.evict(chunk, pageBuffer.data(), pageBuffer.size(), bounds) )
+        return false;
+
+    if ( !pageBuffer.empty() )
+        chunks.invalidate(pageBuffer[0].x, pageBuffer[0].y);
+
+    for ( uint32_t slot : chunkSlots )
+    {
+        BlockHandle handle = blocks.getHandleBySlot(slot);
+        deselect(handle);
+
+        spatialIndex.remove(slot);
+        blocks.remove(handle);
+    }
+
+    return true;
+}
+
+void Map::rebuildIndex()
+{
+    buildIndex();
+
+    for ( unsigned int c = 0; c < blocks.size(); c++ )
+        chunks.invalidate(blocks[c].x, blocks[c].y, spatialIndex.getBounds(blocks.getHandle(c).index));
+}
+
+bool Map::findBlockSize(int id, float& width, float& height)
+{
+    // Sizes are known without loading the texture.
+    sf::Vector2u size = res->getTextureSize(id);
+
+    width = size.x;
+    height = size.y;
+    return size.x > 0;
+}
+
+void Map::queryCamera(sf::View& camera)
+{
+    queryBuffer.clear();
+    if ( !blocks.empty() )
+        spatialIndex.query(getCameraArea(camera), queryBuffer);
+}
+
+std::vector <BlockHandle> Map::getBlocksOnCamera(sf::View& camera)
+{
+    std::vector <BlockHandle> result;
+
+    queryCamera(camera);
+
+    result.reserve(queryBuffer.size());
+    for ( uint32_t slot : queryBuffer )
+        result.push_back(blocks.getHandleBySlot(slot));
    
     return result;
 }
 
+// Writes the 4 corners of the rotated block to quad.
+static void writeBlockQuad(sf::Vertex *quad, const Block& block, const sf::IntRect& rect, sf::Color color)
+{
+    float radians = block.angle * 3.14159265f / 180.0f;
+    float c = std::cos(radians);
+    float s = std::sin(radians);
+
+    float halfWidth  = rect.width / 2.0f;
+    float halfHeight = rect.height / 2.0f;
+
+    const float cornerX[4] = {-halfWidth,  halfWidth, halfWidth, -halfWidth};
+    const float cornerY[4] = {-halfHeight, -halfHeight, halfHeight, halfHeight};
+
+    float left   = rect.left;
+    float top    = rect.top;
+    float right  = rect.left + rect.width;
+    float bottom = rect.top + rect.height;
+
+    const sf::Vector2f texCoords[4] = {{left, top}, {right, top}, {right, bottom}, {left, bottom}};
+
+    for ( int v = 0; v < 4; v++ )
+    {
+        quad[v].position.x = block.x + cornerX[v]*c - cornerY[v]*s;
+        quad[v].position.y = block.y + cornerX[v]*s + cornerY[v]*c;
+        quad[v].texCoords = texCoords[v];
+        quad[v].color = color;
+    }
+}
 
 void Map::draw(sf::RenderWindow& window, sf::View& camera)
 {
@@ -203,119 +618,549 @@ void Map::draw(sf::RenderWindow& window, sf::View& camera)
 
     window.setView(camera);
 
-    for ( auto *block : getBlocksOnCamera(camera) )
+    if ( viewOnly )
+        drawView(window, camera);
+    else if ( sf::VertexBuffer::isAvailable() )
+        drawChunks(window, camera);
+    else
+        drawBatches(window, camera);
+
+    window.setView(window.getDefaultView());
+}
+
+void Map::drawChunks(sf::RenderWindow& window, sf::View& camera)
+{
+    // Regions of the atlas changed, every chunk needs new texture coordinates.
+    if ( atlasPageCount != res->getAtlasPageCount() )
     {
-        sf::Sprite sprite;
-        sprite.setTexture(*res->getTexture(block->id));
-        sprite.setOrigin(sprite.getLocalBounds().width/2.0f, sprite.getLocalBounds().height/2.0f);
-        sprite.setPosition(block->x, block->y);
-        sprite.setRotation(block->angle);
-        
-        if (block == selectedBlock)
-            sprite.setColor(sf::Color::Red);
-        
-        window.draw(sprite);
+        atlasPageCount = res->getAtlasPageCount();
+        chunks.invalidateAll();
     }
 
-    window.setView(window.getDefaultView());
+    visibleChunks.clear();
+    chunks.getVisibleChunks(getCameraArea(camera), visibleChunks);
+
+    // Zoomed out so far that the screen shows less detail than a baked chunk has.
+    float pixelsPerUnit = res->getWindowWidth() / camera.getSize().x;
+    bool useImpostors = pixelsPerUnit <= ImpostorCache::getDetail(gridSize);
+
+    for ( int chunk : visibleChunks )
+    {
+        if ( chunks.isDirty(chunk) )
+            buildChunk(chunk);
+
+        if ( useImpostors )
+            impostors.add(chunk, chunks, res);
+        else
+            chunks.draw(window, chunk, res);
+    }
+
+    if ( useImpostors )
+        impostors.draw(window);
 }
 
-int Map::getGridNumber(int x, int y)
+void Map::buildChunk(int chunk)
 {
-    return getGridY(y) * (info.width/gridSize) + getGridX(x);
+    BlockBounds bounds;
+
+    chunkVertices.resize(res->getAtlasPageCount());
+    for ( auto& vertices : chunkVertices )
+        vertices.clear();
+
+    getChunkBlocks(chunk, chunkSlots);
+
+    for ( uint32_t slot : chunkSlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        bounds.add(spatialIndex.getBounds(slot));
+
+        const AtlasRegion *region = res->getAtlasRegion(block.id);
+        if ( !region )
+            continue;
+
+        std::vector <sf::Vertex>& vertices = chunkVertices[region->page];
+        vertices.resize(vertices.size() + 4);
+        writeBlockQuad(&vertices[vertices.size()-4], block, region->rect, selection.contains(slot) ? sf::Color::Red : sf::Color::White);
+    }
+
+    chunks.setGeometry(chunk, chunkVertices, bounds);
 }
 
-int Map::getGridX(int x)
+void Map::drawBatches(sf::RenderWindow& window, sf::View& camera)
 {
-    if ( x > info.width )
-        x = info.width;
-    
-    return x/gridSize;
+    // One batch of quads per atlas page, memory is kept between frames.
+    if ( pageBatches.size() != (unsigned int)res->getAtlasPageCount() )
+        pageBatches.assign(res->getAtlasPageCount(), sf::VertexArray(sf::Quads));
+
+    for ( auto& batch : pageBatches )
+        batch.clear();
+
+    queryCamera(camera);
+
+    for ( uint32_t slot : queryBuffer )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        const AtlasRegion *region = res->getAtlasRegion(block.id);
+        if ( !region )
+            continue;
+
+        sf::VertexArray& batch = pageBatches[region->page];
+        unsigned int first = batch.getVertexCount();
+
+        batch.resize(first + 4);
+        writeBlockQuad(&batch[first], block, region->rect, selection.contains(slot) ? sf::Color::Red : sf::Color::White);
+    }
+
+    for ( unsigned int page = 0; page < pageBatches.size(); page++ )
+        if ( pageBatches[page].getVertexCount() > 0 )
+            window.draw(pageBatches[page], res->getAtlasPage(page));
 }
 
-int Map::getGridY(int y)
+void Map::drawView(sf::RenderWindow& window, sf::View& camera)
 {
-    if( y > info.height )
-        y = info.height;
-    return y/gridSize;
+    // Same batches as drawBatches, the blocks are decoded from viewBlocks.
+    if ( pageBatches.size() != (unsigned int)res->getAtlasPageCount() )
+        pageBatches.assign(res->getAtlasPageCount(), sf::VertexArray(sf::Quads));
+
+    for ( auto& batch : pageBatches )
+        batch.clear();
+
+    viewBuffer.clear();
+    viewBlocks.queryArea(getCameraArea(camera), viewMargin, viewBuffer);
+
+    for ( const Block& block : viewBuffer )
+    {
+        const AtlasRegion *region = res->getAtlasRegion(block.id);
+        if ( !region )
+            continue;
+
+        sf::VertexArray& batch = pageBatches[region->page];
+        unsigned int first = batch.getVertexCount();
+
+        batch.resize(first + 4);
+        writeBlockQuad(&batch[first], block, region->rect, sf::Color::White);
+    }
+
+    for ( unsigned int page = 0; page < pageBatches.size(); page++ )
+        if ( pageBatches[page].getVertexCount() > 0 )
+            window.draw(pageBatches[page], res->getAtlasPage(page));
 }
 
 void Map::addBlock(float blockX, float blockY, float blockAngle, int blockID)
 {
-    if ( blockID == -1 || !mapReady )
+    if ( blockID == -1 || !mapReady || refuseViewOnly() )
         return;
-    Block *blockPointer = new Block;
-    
-    blockPointer->x = blockX;
-    blockPointer->y = blockY;
-    blockPointer->angle = blockAngle;
-    blockPointer->id = blockID;
 
-    blocks.push_back(blockPointer);
-    blockGrid[getGridNumber(blockX, blockY)].emplace_back(blockPointer);
+    // The rest of the chunk has to be in memory before it can be written back.
+    if ( pager.isOpen() )
+    {
+        int chunk = chunks.getChunk(blockX, blockY);
+        makeResident(chunk);
+        pager.markDirty(chunk);
+    }
+
+    Block block = {blockX, blockY, blockAngle, blockID};
+    insertBlock(block);
+    journal.append(MapJournal::Add, block);
+
+    editCount++;
+}
+
+BlockHandle Map::insertBlock(const Block& block)
+{
+    BlockHandle handle = MapData::insertBlock(block);
+    chunks.invalidate(block.x, block.y, spatialIndex.getBounds(handle.index));
 
-    saved = false;
+    return handle;
 }
 
 void Map::createNew(std::string filename, int width, int height, std::string name, std::string author)
 {
     clear();
 
-    info.name = name;
-    info.author = author;
-    info.width = width;
-    info.height = height;
+    create({width, height, name, author}, gridSize);
+    chunks.create(info.width, info.height, gridSize);
+    impostors.create(chunks.getChunkCount());
 
     mapReady = true;
 }
 
-void Map::selectBlockUnderMouse(sf::Vector2f& mousePos, sf::View& camera)
+BlockHandle Map::getBlockAt(float x, float y)
 {
-    for ( auto *block : getBlocksOnCamera(camera) )
+    pickBuffer.clear();
+    queryPoint(x, y, pickBuffer);
+
+    // Drawn last is on top. Both draw paths go page by page, a page in the
+    // order of the spatial index. That order is the same for every query, so
+    // also for pickBuffer. drawChunks does it chunk by chunk, drawBatches
+    // over all visible blocks at once.
+    bool byChunk = sf::VertexBuffer::isAvailable();
+    BlockHandle top;
+    uint64_t topOrder = 0;
+
+    for ( unsigned int c = 0; c < pickBuffer.size(); c++ )
     {
-        sf::Sprite sprite(*res->getTexture(block->id));
+        const Block& block = *blocks.get(pickBuffer[c]);
+        const AtlasRegion *region = res->getAtlasRegion(block.id);
 
-        sprite.setOrigin(sprite.getTexture()->getSize().x/2.0f, 
-                         sprite.getTexture()->getSize().y/2.0f);
-        sprite.setPosition(block->x, block->y);
-        sprite.rotate(block->angle);
-        
-        if ( sprite.getGlobalBounds().contains(mousePos) )
+        uint64_t chunk = byChunk ? chunks.getChunk(block.x, block.y) : 0;
+        uint64_t order = chunk << 40 | (uint64_t)(region ? region->page : 0) << 32 | c;
+        if ( !top.isValid() || order > topOrder )
         {
-            selectedBlock = block;
-            break;
+            top = pickBuffer[c];
+            topOrder = order;
         }
-
     }
+
+    return top;
 }
 
-void Map::removeBlock(Block *block)
+void Map::selectBlockUnderMouse(sf::Vector2f& mousePos, sf::View& camera)
+{
+    BlockHandle handle = getBlockAt(mousePos.x, mousePos.y);
+
+    if ( handle.isValid() )
+        select(handle);
+}
+
+void Map::removeBlock(BlockHandle handle)
 {
+    Block *block = blocks.get(handle);
     if ( block == nullptr )
         return;
 
+    deselect(handle);
+
+    if ( pager.isOpen() )
+        pager.markDirty(chunks.getChunk(block->x, block->y));
 
-    if ( block == getSelectedBlock())
-        unselect();
+    journal.append(MapJournal::Remove, *block);
 
-    for ( auto it = blocks.begin(); it != blocks.end(); it++ )
+    chunks.invalidate(block->x, block->y);
+    spatialIndex.remove(handle.index);
+    blocks.remove(handle);
+
+    editCount++;
+}
+
+void Map::select(BlockHandle handle)
+{
+    if ( handle == selectedBlock && selection.size() == (blocks.isValid(handle) ? 1u : 0u) )
+        return;
+
+    clearSelection();
+
+    if ( Block *block = blocks.get(handle) )
     {
-        if ( *it == block )
+        selection.add(handle.index);
+        selectedBlock = handle;
+        chunks.invalidate(block->x, block->y);
+    }
+}
+
+void Map::selectArea(const BlockBounds& area, bool add)
+{
+    pickBuffer.clear();
+    queryCenters(area, pickBuffer);
+    selectHandles(add);
+}
+
+void Map::selectLasso(const std::vector<sf::Vector2f>& points, bool add)
+{
+    lassoBuffer.clear();
+    for ( const auto& point : points )
+        lassoBuffer.push_back({point.x, point.y});
+
+    pickBuffer.clear();
+    queryPolygon(lassoBuffer, pickBuffer);
+    selectHandles(add);
+}
+
+void Map::selectHandles(bool add)
+{
+    if ( !add )
+        clearSelection();
+
+    unsigned int added = 0;
+    for ( BlockHandle handle : pickBuffer )
+    {
+        if ( !selection.add(handle.index) )
+            continue;
+
+        // Selection color is baked to the chunk geometry.
+        const Block& block = blocks.getBySlot(handle.index);
+        chunks.invalidate(block.x, block.y);
+        added++;
+    }
+
+    if ( !selectedBlock.isValid() && !pickBuffer.empty() )
+        selectedBlock = pickBuffer.back();
+
+    Console *console = res->getConsole();
+    if ( added > 0 && console )
+        console->addLogLine("Selected " + std::to_string(selection.size()) + " blocks.");
+}
+
+void Map::getSelection(std::vector<BlockHandle>& result)
+{
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    for ( uint32_t slot : selectionSlots )
+        result.push_back(blocks.getHandleBySlot(slot));
+}
+
+bool Map::moveSelection(float dx, float dy)
+{
+    return transformSelection(dx, dy, 0.0f, 0.0f, 0.0f);
+}
+
+bool Map::rotateSelection(float angle)
+{
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    BlockBounds centers;
+    for ( uint32_t slot : selectionSlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        centers.add({block.x, block.y, block.x, block.y});
+    }
+
+    return transformSelection(0.0f, 0.0f, angle, (centers.left + centers.right)/2.0f, (centers.top + centers.bottom)/2.0f);
+}
+
+bool Map::rotateSelection(float angle, float pivotX, float pivotY)
+{
+    return transformSelection(0.0f, 0.0f, angle, pivotX, pivotY);
+}
+
+bool Map::transformSelection(float dx, float dy, float angle, float pivotX, float pivotY)
+{
+    if ( selection.empty() )
+        return false;
+
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    editBuffer.clear();
+    for ( uint32_t slot : selectionSlots )
+        editBuffer.push_back(blocks.getBySlot(slot));
+
+    if ( !transformBlocks(selectionSlots, dx, dy, angle, pivotX, pivotY) )
+    {
+        Console *console = res->getConsole();
+        if ( console )
+            console->addLogLine("Error: Blocks out of the map boundaries!");
+        return false;
+    }
+
+    // Chunks of the old and new places, a chunk is built again only once when drawn.
+    for ( const Block& block : editBuffer )
+    {
+        chunks.invalidate(block.x, block.y);
+        if ( pager.isOpen() )
+            pager.markDirty(chunks.getChunk(block.x, block.y));
+    }
+    journal.append(MapJournal::Remove, editBuffer.data(), editBuffer.size());
+
+    editBuffer.clear();
+    for ( uint32_t slot : selectionSlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        chunks.invalidate(block.x, block.y, spatialIndex.getBounds(slot));
+        editBuffer.push_back(block);
+    }
+    journal.append(MapJournal::Add, editBuffer.data(), editBuffer.size());
+
+    // The rest of the new chunks has to be in memory before they can be written back.
+    if ( pager.isOpen() )
+    {
+        for ( const Block& block : editBuffer )
         {
-            it = blocks.erase(it);
-            break;
+            int chunk = chunks.getChunk(block.x, block.y);
+            makeResident(chunk);
+            pager.markDirty(chunk);
+        }
+    }
+
+    editCount++;
+    return true;
+}
+
+void Map::deleteSelection()
+{
+    if ( selection.empty() )
+        return;
+
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    editBuffer.clear();
+    for ( uint32_t slot : selectionSlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        chunks.invalidate(block.x, block.y);
+        if ( pager.isOpen() )
+            pager.markDirty(chunks.getChunk(block.x, block.y));
+        editBuffer.push_back(block);
+    }
+    journal.append(MapJournal::Remove, editBuffer.data(), editBuffer.size());
+
+    eraseBlocks(selectionSlots);
+    selection.clear();
+    selectedBlock = BlockHandle();
+
+    Console *console = res->getConsole();
+    if ( console )
+        console->addLogLine("Deleted " + std::to_string(selectionSlots.size()) + " blocks.");
+    editCount++;
+}
+
+void Map::copySelection()
+{
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    editBuffer.clear();
+    BlockBounds bounds;
+    for ( uint32_t slot : selectionSlots )
+    {
+        editBuffer.push_back(blocks.getBySlot(slot));
+        bounds.add(spatialIndex.getBounds(slot));
+    }
+
+    clipboard.create(editBuffer, bounds);
+
+    Console *console = res->getConsole();
+    if ( console )
+        console->addLogLine("Copied " + std::to_string(clipboard.size()) + " blocks.");
+}
+
+bool Map::paste(float x, float y, float angle)
+{
+    if ( clipboard.empty() || !mapReady || refuseViewOnly() )
+        return false;
+
+    editBuffer.clear();
+    clipboard.place(x, y, angle, editBuffer);
+    return placeBlocks(editBuffer);
+}
+
+bool Map::tile(const BlockBounds& area, float angle)
+{
+    if ( clipboard.empty() || !mapReady || refuseViewOnly() )
+        return false;
+
+    editBuffer.clear();
+    if ( !clipboard.tile(area, angle, editBuffer) )
+        return false;
+
+    return placeBlocks(editBuffer);
+}
+
+unsigned int Map::getTileBlockCount(const BlockBounds& area, float angle) const
+{
+    return clipboard.getTileBlockCount(area, angle);
+}
+
+bool Map::placeBlocks(const std::vector<Block>& placed)
+{
+    if ( placed.empty() )
+        return false;
+
+    Console *console = res->getConsole();
+
+    for ( const Block& block : placed )
+    {
+        if ( !(block.x >= 0.0f && block.x <= info.width && block.y >= 0.0f && block.y <= info.height) )
+        {
+            if ( console )
+                console->addLogLine("Error: Blocks out of the map boundaries!");
+            return false;
         }
     }
 
-    std::vector <Block *> *gridBlocks = &blockGrid[getGridNumber(block->x, block->y)];
-    for ( auto it = gridBlocks->begin(); it != gridBlocks->end(); it++ )
+    // The rest of the chunks has to be in memory before they can be written back.
+    if ( pager.isOpen() )
     {
-        if ( *it == block )
+        for ( const Block& block : placed )
         {
-            it = gridBlocks->erase(it);
-            break;
+            int chunk = chunks.getChunk(block.x, block.y);
+            makeResident(chunk);
+            pager.markDirty(chunk);
         }
     }
 
-    delete block;
+    placedHandles.clear();
+    insertBlocks(placed, placedHandles);
+    journal.append(MapJournal::Add, placed.data(), placed.size());
+
+    clearSelection();
+    for ( BlockHandle handle : placedHandles )
+    {
+        const Block& block = blocks.getBySlot(handle.index);
+        chunks.invalidate(block.x, block.y, spatialIndex.getBounds(handle.index));
+        selection.add(handle.index);
+    }
+    selectedBlock = placedHandles.back();
+
+    if ( console )
+        console->addLogLine("Pasted " + std::to_string(placed.size()) + " blocks.");
+    editCount++;
+    return true;
+}
+
+bool Map::saveStamp(const std::string& name)
+{
+    if ( selection.empty() )
+        return false;
+
+    copySelection();
+    stamps[name] = clipboard;
+    return true;
+}
+
+bool Map::useStamp(const std::string& name)
+{
+    auto stamp = stamps.find(name);
+    if ( stamp == stamps.end() )
+        return false;
+
+    clipboard = stamp->second;
+    return true;
+}
+
+bool Map::removeStamp(const std::string& name)
+{
+    return stamps.erase(name) > 0;
+}
+
+void Map::getStampNames(std::vector<std::string>& result)
+{
+    for ( const auto& stamp : stamps )
+        result.push_back(stamp.first);
+}
+
+void Map::deselect(BlockHandle handle)
+{
+    selection.remove(handle.index);
+    if ( handle == selectedBlock )
+        selectedBlock = BlockHandle();
+}
+
+void Map::clearSelection()
+{
+    // Selection color is baked to the chunk geometry.
+    selectionSlots.clear();
+    selection.getSlots(selectionSlots);
+
+    for ( uint32_t slot : selectionSlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        chunks.invalidate(block.x, block.y);
+    }
+
+    selection.clear();
+    selectedBlock = BlockHandle();
 }
@@ -2,101 +2,190 @@
 #include <iostream>
 #include <SFML/Graphics.hpp>
 #include <vector>
-
-/*
-    Map file format [ MaP! ] = 0x2150614D = 558915917
-    
-    int [FileFormat Descriptor] = MaP! (4 bytes)
-    int [width]                        (4 bytes)
-    int [height]                       (4 bytes)
-    char [Name size]                   (1 byte)
-    char [Author size]                 (1 byte)
-    char []Name]                       (Name size * bytes)
-    char [][Author]                    (Author size * bytes)
-    int [Block count]                  (Block count)
-
-    [ block data                       (16 bytes)
-        - float x     - 4 bytes
-        - float y     - 4 bytes
-        - float angle - 4 bytes
-        - int id      - 4 bytes                 
-    ] * Block count
-
- */
-
-const int defaultGridSize = 500;
-
-
-struct Block
-{
-    float x, y;
-    float angle;
-
-    int id;
-};
-
-struct MapFile
-{
-    int width, height;
-    std::string name;
-    std::string author;
-};
-
-class Map
+#include <map>
+
+#include "MapData.hpp"
+#include "ChunkRenderer.hpp"
+#include "ImpostorCache.hpp"
+#include "MapPager.hpp"
+#include "MapSaver.hpp"
+#include "MapJournal.hpp"
+#include "BlockSorter.hpp"
+#include "BlockSelection.hpp"
+#include "BlockStamp.hpp"
+#include "CompactBlocks.hpp"
+
+const size_t defaultPageBudget = 512 * 1024 * 1024;
+const size_t residentBlockBytes = 128;     // Block, bounds, index entries and chunk vertices
+const uint64_t journalCompactRecords = 65536;   // Journal is folded to the map file after this many edits
+const uint64_t resortChanges = 16384;           // Blocks are sorted again after this many changes, at least
+
+
+// Editor map: MapData with drawing, selection, paging, background saves and the journal.
+class Map : protected MapData
 {
 public:
     ~Map();
+
+    // Saves on a background thread, paged maps are saved right away.
+    // Returns false when the save could not be started. Until the next
+    // save, edits are written to the journal of the saved file.
     bool saveMap();
-    bool loadMap(std::string filename);
+    bool isSaving() { return saver.isRunning(); }
+    // Paged maps keep only the chunks around the camera in memory, see updatePaging.
+    bool loadMap(std::string filename, bool paged = false);
+    bool isPaged() { return pager.isOpen(); }
+    // Read only map in about 8 bytes a block (CompactBlocks), for looking at
+    // maps too big to edit. Positions are rounded to 1/128 unit, there is no
+    // index or selection, nothing can be edited or saved.
+    bool viewMap(std::string filename);
+    bool isViewOnly() { return viewOnly; }
+
+    // Once a frame: finishes background saves and sorts, compacts the journal and pages chunks.
+    void update(sf::View& camera);
+    // Loads chunks around the camera and evicts far ones over the page budget.
+    void updatePaging(sf::View& camera);
+    void setPageBudget(size_t bytes) { pageBudget = bytes; }
 
     void draw(sf::RenderWindow& window, sf::View& camera);
     void addBlock(float blockX, float blockY, float blockAngle, int blockID);
     void init(class Resources *resources) { res = resources; }
 
-    int getGridNumber(int x, int y);
-    inline int getGridX(int x);
-    inline int getGridY(int y);
-
     void createNew(std::string filename, int width, int height, std::string name, std::string author);
 
-    std::vector <Block *> getBlocksOnCamera(sf::View& camera);
+    std::vector <BlockHandle> getBlocksOnCamera(sf::View& camera);
+    Block *getBlock(BlockHandle handle) { return blocks.get(handle); }
+    using MapData::getBlockBounds;
 
-    bool isSaved() { return saved; }
+    bool isSaved() { return editCount == savedEditCount; }
 
     int getWidth() {  return info.width; }
     int getHeight() { return info.height; }
 
     void setWidthandHeight(int width, int height) { info.width = width; info.height = height;}
-    void setFilename(std::string nameOfFile) {filename = nameOfFile + ".map"; saved = false; }
-    void setName(std::string nameOfLevel)    {info.name = nameOfLevel; saved = false; }
-    void setAuthor(std::string authorName)   {info.author = authorName; saved = false; }
+    void setFilename(std::string nameOfFile) {filename = nameOfFile + ".map"; editCount++; }
+    void setName(std::string nameOfLevel)    {info.name = nameOfLevel; editCount++; }
+    void setAuthor(std::string authorName)   {info.author = authorName; editCount++; }
 
     std::string getFilename()   { return filename; }
     std::string getName()       { return info.name; }
     std::string getAuthor()     { return info.author; }
 
-    Block *getSelectedBlock() { return selectedBlock; }
+    BlockHandle getSelectedBlock() { return selectedBlock; }
 
     bool getReady() { return mapReady; }
 
+    // Topmost block drawn at x,y, invalid handle when there is none.
+    BlockHandle getBlockAt(float x, float y);
     void selectBlockUnderMouse(sf::Vector2f& mousePos, sf::View& camera);
-    void unselect() { selectedBlock = nullptr; }
-
-    void removeBlock(Block *block);
+    // Selects only the block, an invalid handle clears the selection.
+    void select(BlockHandle handle);
+    void unselect() { select(BlockHandle()); }
+    // Blocks centered in the area or the polygon, added to the selection or replacing it.
+    void selectArea(const BlockBounds& area, bool add = false);
+    void selectLasso(const std::vector<sf::Vector2f>& points, bool add = false);
+    bool isSelected(BlockHandle handle) { return blocks.isValid(handle) && selection.contains(handle.index); }
+    unsigned int getSelectionCount() { return selection.size(); }
+    void getSelection(std::vector<BlockHandle>& result);
+
+    // Edits of all selected blocks at once. Moves and turns return false
+    // and change nothing when a block would leave the map.
+    bool moveSelection(float dx, float dy);
+    bool rotateSelection(float angle);      // About the center of the selection
+    bool rotateSelection(float angle, float pivotX, float pivotY);
+    void deleteSelection();
+
+    // The clipboard and the stamps stay when another map is loaded.
+    void copySelection();
+    // Clipboard turned angle degrees and centered at x,y, or as many copies as fit
+    // in area. Pasted blocks are selected. False when a block would be outside the map.
+    bool paste(float x, float y, float angle = 0.0f);
+    bool tile(const BlockBounds& area, float angle = 0.0f);
+    // Blocks tile would place, over maxTileBlocks when the area is refused.
+    unsigned int getTileBlockCount(const BlockBounds& area, float angle = 0.0f) const;
+    // Stamps are named copies of the selection, useStamp puts one to the clipboard.
+    bool saveStamp(const std::string& name);
+    bool useStamp(const std::string& name);
+    bool removeStamp(const std::string& name);
+    void getStampNames(std::vector<std::string>& result);
+
+    void removeBlock(BlockHandle handle);
 
 private:
     void clear();
-
-    MapFile info;
-    std::vector <Block *> blocks;
-    std::map <int, std::vector<Block *>> blockGrid;
+    bool startSave(const std::string& target, bool compact);
+    bool savePaged();
+    void updateSave();
+    bool finishSave();                      // Waits for the save and moves the journal to the saved file
+    void updateSort();
+    void replayJournal(const std::string& journalName, uint64_t mapHash);
+    void removeBlockAt(const Block& block);
+    void rebuildIndex();
+    BlockHandle insertBlock(const Block& block);
+    void getChunkBlocks(int chunk, std::vector<uint32_t>& result);  // Slots of the blocks centered in the chunk
+    void makeResident(int chunk);
+    bool evictChunk(int chunk);
+    void deselect(BlockHandle handle);      // Before the block is removed
+    void clearSelection();
+    void selectHandles(bool add);           // Selects pickBuffer
+    bool transformSelection(float dx, float dy, float angle, float pivotX, float pivotY);
+    bool placeBlocks(const std::vector<Block>& placed);  // Inserts and selects the blocks
+    void queryCamera(sf::View& camera);     // Fills queryBuffer
+    void drawChunks(sf::RenderWindow& window, sf::View& camera);
+    void drawBatches(sf::RenderWindow& window, sf::View& camera);
+    void drawView(sf::RenderWindow& window, sf::View& camera);
+    bool refuseViewOnly();                  // True and logs when the map is only viewed
+    void buildChunk(int chunk);
+    bool findBlockSize(int id, float& width, float& height) override;
+
+    std::vector <uint32_t> queryBuffer;     // Reused between the camera queries
+    std::vector <BlockHandle> pickBuffer;
+    std::vector <sf::VertexArray> pageBatches;  // Visible quads for every atlas page, when there are no vertex buffers
+
+    ChunkRenderer chunks;
+    ImpostorCache impostors;                // Baked chunks for zoomed out views
+    std::vector <int> visibleChunks;
+    std::vector <std::vector<sf::Vertex>> chunkVertices;   // Reused when chunk geometry is built
+    int atlasPageCount = -1;                // Atlas page count when chunks were built
     std::string filename;
 
+    MapPager pager;                         // Open only for paged maps
+    size_t pageBudget = defaultPageBudget;
+    std::vector <int> wantedChunks;         // Chunks kept around the camera
+    std::vector <char> chunkWanted;
+    std::vector <uint32_t> chunkSlots;
+    std::vector <Block> pageBuffer;
+
     int gridSize = defaultGridSize;
     bool mapReady = false;
 
-    bool saved = true;
-
-    class Resources *res;
-    Block *selectedBlock = nullptr;
+    bool viewOnly = false;                  // Blocks are in viewBlocks, the pool is empty
+    CompactBlocks viewBlocks;
+    float viewMargin = 0.0f;                // Biggest reach of a block from its center
+    std::vector <Block> viewBuffer;
+
+    // The map is saved when no edits were made after the last saved snapshot.
+    unsigned int editCount = 0;
+    unsigned int savedEditCount = 0;
+    unsigned int savingEditCount = 0;       // editCount of the snapshot being saved
+    int reportedProgress = 0;
+    MapSaver saver;
+
+    MapJournal journal;                     // Edits after the map file, not used for paged maps
+    uint64_t savingJournalRecords = 0;      // Journal records in the snapshot being saved
+    uint64_t nextCompaction = journalCompactRecords;
+
+    BlockSorter sorter;                     // Restores the storage order after edits
+    uint64_t sortedChangeCount = 0;         // Pool change count when the blocks were last in order
+
+    class Resources *res = nullptr;
+    BlockHandle selectedBlock;              // Last picked block, also in selection
+    BlockSelection selection;               // Slots of the selected blocks
+    std::vector <uint32_t> selectionSlots;
+    std::vector <MapPoint> lassoBuffer;
+    std::vector <Block> editBuffer;         // Blocks of a bulk edit for the journal
+    std::vector <BlockHandle> placedHandles;
+
+    BlockStamp clipboard;
+    std::map <std::string, BlockStamp> stamps;
 };
\ No newline at end of file
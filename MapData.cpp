@@ -0,0 +1,375 @@
+#include "MapData.hpp"
+#include "AtomicWrite.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+void MapData::create(const MapFile& info, int cellSize)
+{
+    this->info = info;
+
+    blocks.clear();
+    blockOrder.create(info.width, info.height, cellSize);
+
+    // Cells near the block size keep point and small area queries to a few blocks,
+    // bigger blocks go to the coarser levels.
+    int indexCell = indexCellSize;
+    while ( indexCell < cellSize &&
+            (int64_t)(info.width / indexCell + 1) * (info.height / indexCell + 1) > maxIndexCells )
+        indexCell *= 2;
+
+    spatialIndex.create(info.width, info.height, indexCell);
+}
+
+bool MapData::load(const std::string& filename, int cellSize)
+{
+    MapReader mapFile;
+    if ( !mapFile.open(filename) )
+        return false;
+
+    create(mapFile.getInfo(), cellSize);
+    blocks.assign(mapFile.getBlockData(), mapFile.getBlockCount());
+    orderBlocks();
+    buildIndex();
+
+    return true;
+}
+
+bool MapData::save(const std::string& filename, bool keepBackup)
+{
+    std::vector <BlockBounds> bounds(blocks.size());
+
+    for ( unsigned int c = 0; c < blocks.size(); c++ )
+        bounds[c] = spatialIndex.getBounds(blocks.getHandle(c).index);
+
+    std::vector <char> buffer = writeMapV2(info, blocks.empty() ? nullptr : &blocks[0], blocks.size(),
+                                           blockOrder.layout.getCellSize(), bounds.data());
+
+    return writeFileAtomic(filename, buffer.data(), buffer.size(), keepBackup);
+}
+
+BlockHandle MapData::insertBlock(const Block& block)
+{
+    BlockHandle handle = blocks.add(block);
+    spatialIndex.insert(handle.index, getBlockBounds(block));
+    setShape(handle.index, block);
+
+    return handle;
+}
+
+void MapData::insertBlocks(const std::vector<Block>& newBlocks, std::vector<BlockHandle>& result)
+{
+    transformSlots.clear();
+    transformBounds.clear();
+
+    // Shapes need the block sizes, which getBlockBounds finds.
+    for ( const Block& block : newBlocks )
+    {
+        BlockHandle handle = blocks.add(block);
+        result.push_back(handle);
+        transformSlots.push_back(handle.index);
+        transformBounds.push_back(getBlockBounds(block));
+        setShape(handle.index, block);
+    }
+
+    spatialIndex.insert(transformSlots, transformBounds);
+}
+
+bool MapData::eraseBlock(BlockHandle handle)
+{
+    if ( !blocks.isValid(handle) )
+        return false;
+
+    spatialIndex.remove(handle.index);
+    blocks.remove(handle);
+    return true;
+}
+
+bool MapData::transformBlocks(const std::vector<uint32_t>& slots, float dx, float dy,
+                              float angle, float pivotX, float pivotY)
+{
+    unsigned int count = slots.size();
+    transformX.resize(count);
+    transformY.resize(count);
+
+    for ( unsigned int c = 0; c < count; c++ )
+    {
+        const Block& block = blocks.getBySlot(slots[c]);
+        transformX[c] = block.x - pivotX;
+        transformY[c] = block.y - pivotY;
+    }
+
+    float cos, sin;
+    bool quarterTurn = getTurn(angle, cos, sin);
+
+    // Plain arrays without branches, the compiler does several blocks at once.
+    float width = info.width;
+    float height = info.height;
+    int outside = 0;
+
+    for ( unsigned int c = 0; c < count; c++ )
+    {
+        float x = transformX[c]*cos - transformY[c]*sin + pivotX + dx;
+        float y = transformX[c]*sin + transformY[c]*cos + pivotY + dy;
+
+        outside |= !(x >= 0.0f) | !(x <= width) | !(y >= 0.0f) | !(y <= height);
+        transformX[c] = x;
+        transformY[c] = y;
+    }
+
+    if ( outside )
+        return false;
+
+    transformBounds.resize(count);
+
+    for ( unsigned int c = 0; c < count; c++ )
+    {
+        uint32_t slot = slots[c];
+        Block& block = blocks.getBySlot(slot);
+
+        block.x = transformX[c];
+        block.y = transformY[c];
+
+        if ( angle != 0.0f )
+            block.angle = addAngle(block.angle, angle);
+
+        if ( !quarterTurn )
+        {
+            transformBounds[c] = getBlockBounds(block);
+            setShape(slot, block);
+            continue;
+        }
+
+        // Boxes stay axis aligned in quarter turns, so bounds and shapes turn with the blocks.
+        const BlockBounds& bounds = spatialIndex.getBounds(slot);
+        float left   = (bounds.left - pivotX)*cos - (bounds.top - pivotY)*sin;
+        float top    = (bounds.left - pivotX)*sin + (bounds.top - pivotY)*cos;
+        float right  = (bounds.right - pivotX)*cos - (bounds.bottom - pivotY)*sin;
+        float bottom = (bounds.right - pivotX)*sin + (bounds.bottom - pivotY)*cos;
+
+        transformBounds[c] = {std::fmin(left, right) + pivotX + dx, std::fmin(top, bottom) + pivotY + dy,
+                              std::fmax(left, right) + pivotX + dx, std::fmax(top, bottom) + pivotY + dy};
+
+        BlockShape& shape = blockShapes[slot];
+        float shapeCos = shape.cos*cos - shape.sin*sin;
+        shape.sin = shape.sin*cos + shape.cos*sin;
+        shape.cos = shapeCos;
+        shape.x = block.x;
+        shape.y = block.y;
+    }
+
+    spatialIndex.update(slots, transformBounds);
+
+    blocks.markChanged(count);
+    return true;
+}
+
+void MapData::eraseBlocks(const std::vector<uint32_t>& slots)
+{
+    for ( uint32_t slot : slots )
+    {
+        spatialIndex.remove(slot);
+        blocks.remove(blocks.getHandleBySlot(slot));
+    }
+}
+
+void MapData::orderBlocks()
+{
+    std::vector <uint32_t> order;
+    if ( blocks.empty() || !::getBlockOrder(blockOrder, &blocks[0], blocks.size(), order) )
+        return;
+
+    blocks.reorder(order);
+}
+
+void MapData::queryArea(const BlockBounds& area, std::vector<BlockHandle>& result)
+{
+    querySlots.clear();
+    spatialIndex.query(area, querySlots);
+
+    for ( uint32_t slot : querySlots )
+        result.push_back(blocks.getHandleBySlot(slot));
+}
+
+void MapData::queryPoint(float x, float y, std::vector<BlockHandle>& result)
+{
+    querySlots.clear();
+    spatialIndex.query({x, y, x, y}, querySlots);
+
+    // Point to the frame of every candidate first, then the test runs over plain arrays.
+    pointX.resize(querySlots.size());
+    pointY.resize(querySlots.size());
+
+    for ( unsigned int c = 0; c < querySlots.size(); c++ )
+    {
+        const BlockShape& shape = blockShapes[querySlots[c]];
+        float dx = x - shape.x;
+        float dy = y - shape.y;
+
+        pointX[c] = std::fabs(dx*shape.cos + dy*shape.sin) - shape.halfWidth;
+        pointY[c] = std::fabs(dy*shape.cos - dx*shape.sin) - shape.halfHeight;
+    }
+
+    for ( unsigned int c = 0; c < querySlots.size(); c++ )
+        if ( std::fmax(pointX[c], pointY[c]) <= 0.0f )
+            result.push_back(blocks.getHandleBySlot(querySlots[c]));
+}
+
+void MapData::queryCenters(const BlockBounds& area, std::vector<BlockHandle>& result)
+{
+    querySlots.clear();
+    spatialIndex.query(area, querySlots);
+
+    for ( uint32_t slot : querySlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        if ( area.contains(block.x, block.y) )
+            result.push_back(blocks.getHandleBySlot(slot));
+    }
+}
+
+void MapData::queryPolygon(const std::vector<MapPoint>& polygon, std::vector<BlockHandle>& result)
+{
+    if ( polygon.size() < 3 )
+        return;
+
+    BlockBounds area;
+    for ( const auto& point : polygon )
+        area.add({point.x, point.y, point.x, point.y});
+
+    querySlots.clear();
+    spatialIndex.query(area, querySlots);
+
+    for ( uint32_t slot : querySlots )
+    {
+        const Block& block = blocks.getBySlot(slot);
+        if ( !area.contains(block.x, block.y) )
+            continue;
+
+        // Edges crossed by a ray to the right of the center.
+        bool inside = false;
+        for ( size_t c = 0, previous = polygon.size()-1; c < polygon.size(); previous = c++ )
+        {
+            const MapPoint& a = polygon[c];
+            const MapPoint& b = polygon[previous];
+
+            if ( (a.y > block.y) != (b.y > block.y) &&
+                 block.x < a.x + (block.y - a.y) * (b.x - a.x) / (b.y - a.y) )
+                inside = !inside;
+        }
+
+        if ( inside )
+            result.push_back(blocks.getHandleBySlot(slot));
+    }
+}
+
+void MapData::setBlockSize(int id, float width, float height)
+{
+    if ( id >= 0 )
+        blockSizes[id] = {width, height};
+}
+
+BlockBounds MapData::getBlockBounds(const Block& block)
+{
+    if ( block.id < 0 )
+        return {block.x, block.y, block.x, block.y};
+
+    // Ids with no size found are kept as points, so they are looked for only once.
+    auto found = blockSizes.find(block.id);
+    if ( found == blockSizes.end() )
+    {
+        BlockSize size;
+        findBlockSize(block.id, size.width, size.height);
+        found = blockSizes.insert({block.id, size}).first;
+    }
+
+    const BlockSize& size = found->second;
+    return getRotatedBounds(block.x, block.y, block.angle, size.width, size.height);
+}
+
+void MapData::buildIndex()
+{
+    std::vector <BlockBounds> bounds(blocks.getSlotCount());
+    blockShapes.resize(blocks.getSlotCount());
+
+    for ( unsigned int c = 0; c < blocks.size(); c++ )
+    {
+        bounds[blocks.getSlot(c)] = getBlockBounds(blocks[c]);
+        setShape(blocks.getSlot(c), blocks[c]);
+    }
+
+    spatialIndex.build(bounds);
+}
+
+void MapData::setShape(uint32_t slot, const Block& block)
+{
+    if ( slot >= blockShapes.size() )
+        blockShapes.resize(blocks.getSlotCount());
+
+    // Same rotation as the drawn quads, sizes are known after getBlockBounds.
+    float radians = block.angle * 3.14159265f / 180.0f;
+    float width = 0.0f, height = 0.0f;
+
+    auto found = blockSizes.find(block.id);
+    if ( found != blockSizes.end() )
+    {
+        width = std::fmax(found->second.width, 0.0f);
+        height = std::fmax(found->second.height, 0.0f);
+    }
+
+    blockShapes[slot] = {block.x, block.y, std::cos(radians), std::sin(radians), width / 2.0f, height / 2.0f};
+}
+
+bool MapData::validate(std::vector<std::string>& problems)
+{
+    return validateBlocks(info, blocks.size() > 0 ? &blocks[0] : nullptr, blocks.size(), problems);
+}
+
+bool validateBlocks(const MapFile& info, const Block *blocks, unsigned int blockCount, std::vector<std::string>& problems)
+{
+    BlockProblems found;
+    found.check(info, blocks, blockCount);
+    return found.report(info, problems);
+}
+
+void BlockProblems::check(const MapFile& info, const Block *blocks, unsigned int blockCount)
+{
+    for ( unsigned int c = 0; c < blockCount; c++ )
+    {
+        const Block& block = blocks[c];
+
+        if ( !std::isfinite(block.x) || !std::isfinite(block.y) || !std::isfinite(block.angle) )
+            notFinite++;
+        else if ( block.x < 0.0f || block.y < 0.0f || block.x > info.width || block.y > info.height )
+            outside++;
+
+        if ( block.id < 0 || block.id > maxBlockId )
+            badId++;
+    }
+
+    // Same block twice on top of itself.
+    std::vector <Block> sorted(blocks, blocks + blockCount);
+    auto compare = [](const Block& a, const Block& b) { return std::memcmp(&a, &b, sizeof(Block)) < 0; };
+    auto equal = [](const Block& a, const Block& b) { return std::memcmp(&a, &b, sizeof(Block)) == 0; };
+
+    std::sort(sorted.begin(), sorted.end(), compare);
+    duplicates += sorted.end() - std::unique(sorted.begin(), sorted.end(), equal);
+}
+
+bool BlockProblems::report(const MapFile& info, std::vector<std::string>& problems) const
+{
+    size_t firstProblem = problems.size();
+
+    if ( info.width <= 0 || info.height <= 0 )
+        problems.push_back("Map size " + std::to_string(info.width) + "x" + std::to_string(info.height) + " is not valid.");
+    if ( notFinite > 0 )
+        problems.push_back(std::to_string(notFinite) + " blocks have a position or angle that is not a number.");
+    if ( outside > 0 )
+        problems.push_back(std::to_string(outside) + " blocks are outside the map.");
+    if ( badId > 0 )
+        problems.push_back(std::to_string(badId) + " blocks have a negative id or one over " + std::to_string(maxBlockId) + ".");
+    if ( duplicates > 0 )
+        problems.push_back(std::to_string(duplicates) + " blocks are duplicates of another block.");
+
+    return problems.size() == firstProblem;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "BlockPool.hpp"
+#include "SpatialIndex.hpp"
+#include "MapFormat.hpp"
+#include "BlockOrder.hpp"
+
+// Map file formats are described in MapFormat.hpp
+
+const int defaultGridSize = 500;
+const int indexCellSize = 64;               // Finest cells of the spatial index, about a block
+const int maxIndexCells = 1 << 18;          // Bigger cells on huge maps, every cell has some slack memory
+const int maxBlockId = 1 << 20;             // Higher ids are taken as a broken file by validate
+
+// Problems of the blocks of a map, counted a part at a time so a file can be
+// checked chunk by chunk. Duplicates are looked for inside each part, the same
+// block twice is always in the same chunk.
+struct BlockProblems
+{
+    unsigned int notFinite = 0;
+    unsigned int outside = 0;
+    unsigned int badId = 0;
+    unsigned int duplicates = 0;
+
+    void check(const MapFile& info, const Block *blocks, unsigned int blockCount);
+    // Appends a line for every problem found, true when there were none.
+    bool report(const MapFile& info, std::vector<std::string>& problems) const;
+};
+
+// All blocks as one part.
+bool validateBlocks(const MapFile& info, const Block *blocks, unsigned int blockCount, std::vector<std::string>& problems);
+
+/*
+    Blocks of one map with the spatial index over them, without anything
+    that needs a window. The editor Map is built on this, tools and the
+    game can use it as it is.
+
+    Block bounds need the size of each block id. Sizes are set with
+    setBlockSize, or found on first use with findBlockSize. Blocks with no
+    known size are points.
+ */
+
+class MapData
+{
+public:
+    virtual ~MapData() {}
+
+    // Empty map, block sizes are kept.
+    void create(const MapFile& info, int cellSize = defaultGridSize);
+    // Whole map from a v1 or v2 file.
+    bool load(const std::string& filename, int cellSize = defaultGridSize);
+    // v2 file on this thread.
+    bool save(const std::string& filename, bool keepBackup = false);
+
+    const MapFile& getInfo() const { return info; }
+    const BlockPool& getBlocks() const { return blocks; }
+    unsigned int getBlockCount() const { return blocks.size(); }
+
+    const Block *getBlock(BlockHandle handle) const { return blocks.get(handle); }
+    BlockHandle insertBlock(const Block& block);
+    bool eraseBlock(BlockHandle handle);
+    // Adds all blocks to the pool and the index in one go, appends their handles to result.
+    void insertBlocks(const std::vector<Block>& newBlocks, std::vector<BlockHandle>& result);
+
+    // Turns the blocks of slots angle degrees about pivotX,pivotY and moves them by dx,dy.
+    // Returns false and changes nothing when a block would end up outside the map.
+    bool transformBlocks(const std::vector<uint32_t>& slots, float dx, float dy,
+                         float angle = 0.0f, float pivotX = 0.0f, float pivotY = 0.0f);
+    void eraseBlocks(const std::vector<uint32_t>& slots);
+
+    // Puts the blocks to the storage order of BlockOrder.hpp, handles stay valid.
+    void orderBlocks();
+    const BlockOrder& getBlockOrder() const { return blockOrder; }
+
+    // Blocks whose bounds intersect area.
+    void queryArea(const BlockBounds& area, std::vector<BlockHandle>& result);
+    // Blocks whose rotated rectangle covers x,y, in the order of the spatial index.
+    void queryPoint(float x, float y, std::vector<BlockHandle>& result);
+    // Blocks centered inside area.
+    void queryCenters(const BlockBounds& area, std::vector<BlockHandle>& result);
+    // Blocks centered inside the polygon, even-odd rule for polygons that cross themselves.
+    void queryPolygon(const std::vector<MapPoint>& polygon, std::vector<BlockHandle>& result);
+
+    void setBlockSize(int id, float width, float height);
+    BlockBounds getBlockBounds(const Block& block);
+
+    // Appends a line for every problem found, true when there were none.
+    bool validate(std::vector<std::string>& problems);
+
+protected:
+    struct BlockSize
+    {
+        float width = 0.0f;
+        float height = 0.0f;
+    };
+
+    // Rotated rectangle of a block, kept for point queries.
+    struct BlockShape
+    {
+        float x, y;
+        float cos, sin;
+        float halfWidth, halfHeight;
+    };
+
+    virtual bool findBlockSize(int /*id*/, float& /*width*/, float& /*height*/) { return false; }
+
+    // Builds the spatial index of all blocks from scratch.
+    void buildIndex();
+    // Updates the shape of slot after the block moved or was added.
+    void setShape(uint32_t slot, const Block& block);
+
+    MapFile info = {0, 0, "", ""};
+    BlockPool blocks;
+    BlockOrder blockOrder;
+    SpatialIndex spatialIndex;              // Slots of the blocks pool
+    // By block id. Ids come from the file as they are, so no array by id.
+    std::unordered_map <int, BlockSize> blockSizes;
+    std::vector <BlockShape> blockShapes;   // By slot
+
+private:
+    std::vector <uint32_t> querySlots;
+    std::vector <float> pointX, pointY;     // Point query candidates in local coordinates
+    std::vector <float> transformX, transformY;
+    std::vector <uint32_t> transformSlots;  // Of insertBlocks
+    std::vector <BlockBounds> transformBounds;
+};
@@ -0,0 +1,281 @@
+#include "MapFormat.hpp"
+#include "BlockOrder.hpp"
+#include <algorithm>
+#include <cstring>
+
+const size_t headerFixedSize = 14;      // ID, width, height, name and author lengths
+const size_t chunkHeaderSize = 16;      // Chunk size, columns, rows and count in v2
+const size_t chunkEntrySize = 32;
+
+static_assert(sizeof(Block) == 16, "Block has to match the block data of the map file");
+
+namespace
+{
+    class Writer
+    {
+    public:
+        Writer(std::vector<char>& buffer) : position(buffer.data()) {}
+
+        void write(const void *data, size_t size)
+        {
+            if ( size > 0 )
+                std::memcpy(position, data, size);
+            position += size;
+        }
+
+        template <class T>
+        void write(const T& value) { write(&value, sizeof(T)); }
+
+    private:
+        char *position;
+    };
+
+    // Everything up to and including the block count, same in both versions.
+    size_t getHeaderSize(const MapFile& info)
+    {
+        return headerFixedSize + std::min<size_t>(info.name.length(), 255) +
+               std::min<size_t>(info.author.length(), 255) + 4;
+    }
+
+    void writeHeader(Writer& writer, int id, const MapFile& info, int blockCount)
+    {
+        unsigned char nameLength = std::min<size_t>(info.name.length(), 255);
+        unsigned char authorLength = std::min<size_t>(info.author.length(), 255);
+
+        writer.write(id);                                   // MaP! / MaP2
+        writer.write(info.width);                           // Width
+        writer.write(info.height);                          // Height
+        writer.write(nameLength);                           // Name length
+        writer.write(authorLength);                         // Author name length
+        writer.write(info.name.c_str(), nameLength);        // Map name
+        writer.write(info.author.c_str(), authorLength);    // Author name
+        writer.write(blockCount);                           // Block count
+    }
+}
+
+std::vector<char> writeMapV1(const MapFile& info, const Block *blocks, unsigned int blockCount)
+{
+    std::vector <char> buffer(getHeaderSize(info) + blockCount * sizeof(Block));
+    Writer writer(buffer);
+
+    writeHeader(writer, mapID, info, blockCount);
+    writer.write(blocks, blockCount * sizeof(Block));
+
+    return buffer;
+}
+
+std::vector<char> writeMapV2Header(const MapFile& info, const GridLayout& layout, std::vector<MapChunkEntry>& directory)
+{
+    uint64_t blockOffset = getHeaderSize(info) + chunkHeaderSize + directory.size() * chunkEntrySize;
+    int blockCount = 0;
+
+    for ( auto& entry : directory )
+    {
+        entry.offset = blockOffset + (uint64_t)blockCount * sizeof(Block);
+        blockCount += entry.blockCount;
+    }
+
+    std::vector <char> buffer(blockOffset);
+    Writer writer(buffer);
+
+    writeHeader(writer, mapIDv2, info, blockCount);
+    writer.write(layout.getCellSize());
+    writer.write(layout.getColumns());
+    writer.write(layout.getRows());
+    writer.write((int)directory.size());
+
+    for ( const auto& entry : directory )
+    {
+        writer.write(entry.chunk);
+        writer.write(entry.blockCount);
+        writer.write(entry.offset);
+        writer.write(entry.bounds.left);
+        writer.write(entry.bounds.top);
+        writer.write(entry.bounds.right);
+        writer.write(entry.bounds.bottom);
+    }
+
+    return buffer;
+}
+
+std::vector<char> writeMapV2(const MapFile& info, const Block *blocks, unsigned int blockCount,
+                             int chunkSize, const BlockBounds *bounds)
+{
+    BlockOrder blockOrder;
+    blockOrder.create(info.width, info.height, chunkSize);
+    const GridLayout& layout = blockOrder.layout;
+
+    // Blocks by chunk, and by Morton code inside the chunk.
+    std::vector <uint32_t> order;
+    if ( !getBlockOrder(blockOrder, blocks, blockCount, order) )
+    {
+        order.resize(blockCount);
+        for ( unsigned int c = 0; c < blockCount; c++ )
+            order[c] = c;
+    }
+
+    std::vector <MapChunkEntry> directory;
+    unsigned int last = 0;
+
+    for ( unsigned int first = 0; first < blockCount; first = last )
+    {
+        int chunk = layout.getCell(blocks[order[first]].x, blocks[order[first]].y);
+        BlockBounds chunkBounds;
+
+        for ( last = first; last < blockCount; last++ )
+        {
+            const Block& block = blocks[order[last]];
+            if ( layout.getCell(block.x, block.y) != chunk )
+                break;
+
+            chunkBounds.add(bounds ? bounds[order[last]] : BlockBounds{block.x, block.y, block.x, block.y});
+        }
+
+        directory.push_back({chunk, (int)(last - first), 0, chunkBounds});
+    }
+
+    std::vector <char> buffer = writeMapV2Header(info, layout, directory);
+    size_t blockOffset = buffer.size();
+
+    buffer.resize(blockOffset + blockCount * sizeof(Block));
+    for ( unsigned int c = 0; c < blockCount; c++ )
+        std::memcpy(&buffer[blockOffset + c * sizeof(Block)], &blocks[order[c]], sizeof(Block));
+
+    return buffer;
+}
+
+bool MapReader::open(const std::string& filename)
+{
+    close();
+
+    if ( !file.open(filename) )
+        return false;
+
+    const char *data = file.getData();
+    size_t size = file.getSize();
+    size_t position = headerFixedSize;
+
+    auto read = [data](void *target, size_t offset, size_t length) {
+        std::memcpy(target, data + offset, length);
+    };
+
+    int id = 0;
+    int count = 0;
+
+    if ( size < headerFixedSize )
+        return false;
+
+    read(&id,           0, 4);  // File ID
+    read(&info.width,   4, 4);  // Width
+    read(&info.height,  8, 4);  // Height
+    unsigned char nameLength   = data[12];
+    unsigned char authorLength = data[13];
+
+    if ( info.width < 0 || info.height < 0 || info.width > maxMapSize || info.height > maxMapSize )
+        return false;
+
+    if ( id == mapID )
+        version = 1;
+    else if ( id == mapIDv2 )
+        version = 2;
+    else
+        return false;
+
+    if ( size < position + nameLength + authorLength + 4 )
+        return false;
+
+    info.name.assign(data + position, nameLength);
+    position += nameLength;
+    info.author.assign(data + position, authorLength);
+    position += authorLength;
+
+    read(&count, position, 4);  // Block count
+    position += 4;
+
+    if ( count < 0 )
+        return false;
+    blockCount = count;
+
+    if ( version == 1 )
+    {
+        if ( (size - position) / sizeof(Block) < blockCount )
+            return false;
+
+        chunkSize = 0;
+        firstBlockOffset = position;
+        chunks.push_back({-1, count, position, BlockBounds()});
+        return true;
+    }
+
+    int columns = 0, rows = 0, chunkCount = 0;
+
+    if ( size < position + chunkHeaderSize )
+        return false;
+
+    read(&chunkSize,    position,      4);
+    read(&columns,      position + 4,  4);
+    read(&rows,         position + 8,  4);
+    read(&chunkCount,   position + 12, 4);
+    position += chunkHeaderSize;
+
+    if ( chunkSize <= 0 || chunkCount < 0 || (size - position) / chunkEntrySize < (size_t)chunkCount )
+        return false;
+
+    // Chunk grids are made from the chunk size, and the chunk numbers have to fit an int.
+    GridLayout layout;
+    layout.create(info.width, info.height, chunkSize);
+    int64_t cellCount = (int64_t)columns * rows;
+
+    if ( columns <= 0 || rows <= 0 || cellCount > maxMapCells || layout.getCellCount() > maxMapCells )
+        return false;
+
+    firstBlockOffset = position + chunkCount * chunkEntrySize;
+
+    // Chunks have to cover the block area back to back, in order.
+    uint64_t expectedOffset = firstBlockOffset;
+    chunks.resize(chunkCount);
+    for ( auto& entry : chunks )
+    {
+        read(&entry.chunk,          position,      4);
+        read(&entry.blockCount,     position + 4,  4);
+        read(&entry.offset,         position + 8,  8);
+        read(&entry.bounds.left,    position + 16, 4);
+        read(&entry.bounds.top,     position + 20, 4);
+        read(&entry.bounds.right,   position + 24, 4);
+        read(&entry.bounds.bottom,  position + 28, 4);
+        position += chunkEntrySize;
+
+        if ( entry.blockCount < 0 || entry.chunk < 0 || entry.chunk >= cellCount ||
+             entry.offset != expectedOffset )
+        {
+            chunks.clear();
+            return false;
+        }
+
+        expectedOffset += (uint64_t)entry.blockCount * sizeof(Block);
+    }
+
+    if ( expectedOffset != firstBlockOffset + (uint64_t)blockCount * sizeof(Block) || expectedOffset > size )
+    {
+        chunks.clear();
+        return false;
+    }
+
+    return true;
+}
+
+void MapReader::findChunks(const BlockBounds& area, std::vector<int>& result) const
+{
+    for ( unsigned int c = 0; c < chunks.size(); c++ )
+        if ( chunks[c].bounds.isEmpty() || chunks[c].bounds.intersects(area) )
+            result.push_back(c);
+}
+
+void MapReader::readChunk(int entry, std::vector<Block>& result) const
+{
+    size_t first = result.size();
+    result.resize(first + chunks[entry].blockCount);
+
+    if ( chunks[entry].blockCount > 0 )
+        std::memcpy(&result[first], getChunkData(entry), chunks[entry].blockCount * sizeof(Block));
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "BlockPool.hpp"
+#include "SpatialIndex.hpp"
+#include "MappedFile.hpp"
+#include "GridLayout.hpp"
+
+/*
+    Map file format v1 [ MaP! ] = 0x2150614D = 558915917
+
+    int [FileFormat Descriptor] = MaP! (4 bytes)
+    int [width]                        (4 bytes)
+    int [height]                       (4 bytes)
+    char [Name size]                   (1 byte)
+    char [Author size]                 (1 byte)
+    char []Name]                       (Name size * bytes)
+    char [][Author]                    (Author size * bytes)
+    int [Block count]                  (Block count)
+
+    [ block data                       (16 bytes)
+        - float x     - 4 bytes
+        - float y     - 4 bytes
+        - float angle - 4 bytes
+        - int id      - 4 bytes
+    ] * Block count
+
+
+    Map file format v2 [ MaP2 ] = 0x3250614D = 844128589
+
+    Same header as v1 up to the block count, then the blocks are grouped
+    by chunk and a directory tells where every chunk is.
+
+    int [FileFormat Descriptor] = MaP2 (4 bytes)
+    int [width]                        (4 bytes)
+    int [height]                       (4 bytes)
+    char [Name size]                   (1 byte)
+    char [Author size]                 (1 byte)
+    char []Name]                       (Name size * bytes)
+    char [][Author]                    (Author size * bytes)
+    int [Block count]                  (4 bytes)
+    int [Chunk size]                   (4 bytes)
+    int [Chunk columns]                (4 bytes)
+    int [Chunk rows]                   (4 bytes)
+    int [Chunk count]                  (4 bytes, only chunks that have blocks)
+
+    [ chunk entry                      (32 bytes)
+        - int chunk          - 4 bytes (row * columns + column)
+        - int block count    - 4 bytes
+        - int64 offset       - 8 bytes (from the start of the file)
+        - float left, top,
+          right, bottom      - 16 bytes (bounds of the blocks in the chunk)
+    ] * Chunk count
+
+    [ block data                       (16 bytes, same as v1)
+    ] * Block count, chunk by chunk in the directory order, by Morton
+        code inside a chunk (BlockOrder.hpp, readers don't depend on it)
+ */
+
+const int mapID   = 0x2150614D;     // MaP!
+const int mapIDv2 = 0x3250614D;     // MaP2
+
+// Bigger maps are taken as broken files when opened, the chunk grids over
+// the map would not fit in memory. A million units wide map with chunks of
+// 500 is just under maxMapCells.
+const int maxMapSize = 1000000;
+const int64_t maxMapCells = 1 << 22;
+
+struct MapFile
+{
+    int width, height;
+    std::string name;
+    std::string author;
+};
+
+struct MapChunkEntry
+{
+    int chunk;                  // -1 in v1 files, the whole map is one entry
+    int blockCount;
+    uint64_t offset;
+    BlockBounds bounds;         // Empty in v1 files
+};
+
+// Serializes the map to v2. bounds can be nullptr, then block centers are used.
+std::vector<char> writeMapV2(const MapFile& info, const Block *blocks, unsigned int blockCount,
+                             int chunkSize, const BlockBounds *bounds = nullptr);
+
+// Header and chunk directory of a v2 file, for writing the blocks chunk by
+// chunk afterwards. directory has the used chunks in order with their
+// block counts and bounds, the offsets are filled here.
+std::vector<char> writeMapV2Header(const MapFile& info, const GridLayout& layout, std::vector<MapChunkEntry>& directory);
+
+// Serializes the map to v1.
+std::vector<char> writeMapV1(const MapFile& info, const Block *blocks, unsigned int blockCount);
+
+/*
+    Reads v1 and v2 map files. The file is memory mapped and the header and
+    chunk directory are checked on open, blocks are copied only when asked.
+ */
+
+class MapReader
+{
+public:
+    bool open(const std::string& filename);
+    void close() { file.close(); chunks.clear(); }
+
+    int getVersion() const { return version; }
+    const MapFile& getInfo() const { return info; }
+    int getChunkSize() const { return chunkSize; }
+    unsigned int getBlockCount() const { return blockCount; }
+
+    const std::vector<MapChunkEntry>& getChunks() const { return chunks; }
+
+    // Directory entries whose bounds intersect area. Entries without bounds always match.
+    void findChunks(const BlockBounds& area, std::vector<int>& result) const;
+
+    // Raw block data, may be unaligned. All blocks are stored back to back.
+    const char *getBlockData() const { return file.getData() + firstBlockOffset; }
+    const char *getChunkData(int entry) const { return file.getData() + chunks[entry].offset; }
+
+    // The whole file as it is on disk.
+    const char *getFileData() const { return file.getData(); }
+    size_t getFileSize() const { return file.getSize(); }
+
+    void readChunk(int entry, std::vector<Block>& result) const;
+
+private:
+    MappedFile file;
+
+    int version = 0;
+    MapFile info;
+    int chunkSize = 0;
+    unsigned int blockCount = 0;
+    uint64_t firstBlockOffset = 0;
+
+    std::vector <MapChunkEntry> chunks;
+};
@@ -0,0 +1,170 @@
+#include "MapJournal.hpp"
+#include "MappedFile.hpp"
+#include "AtomicWrite.hpp"
+#include <cstring>
+#include <algorithm>
+#include <system_error>
+
+#ifdef linux
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+const size_t journalHeaderSize = 12;
+const size_t journalRecordSize = 20;
+
+uint64_t hashMapFile(const char *data, size_t size)
+{
+    // FNV-1a, 8 bytes at a time.
+    uint64_t hash = 14695981039346656037ull;
+    size_t position = 0;
+
+    for ( ; position + 8 <= size; position += 8 )
+    {
+        uint64_t word;
+        std::memcpy(&word, data + position, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+
+    for ( ; position < size; position++ )
+        hash = (hash ^ (unsigned char)data[position]) * 1099511628211ull;
+
+    return hash ^ size;
+}
+
+static std::vector<char> makeHeader(uint64_t mapHash)
+{
+    std::vector <char> header(journalHeaderSize);
+    std::memcpy(&header[0], &journalID, 4);
+    std::memcpy(&header[4], &mapHash, 8);
+    return header;
+}
+
+bool MapJournal::read(const std::string& filename, uint64_t mapHash, std::vector<Record>& result)
+{
+    MappedFile journal;
+    if ( !journal.open(filename) || journal.getSize() < journalHeaderSize )
+        return false;
+
+    const char *data = journal.getData();
+    if ( std::memcmp(data, makeHeader(mapHash).data(), journalHeaderSize) != 0 )
+        return false;
+
+    size_t count = (journal.getSize() - journalHeaderSize) / journalRecordSize;
+    size_t first = result.size();
+    result.resize(first + count);
+
+    for ( size_t c = 0; c < count; c++ )
+    {
+        const char *record = data + journalHeaderSize + c * journalRecordSize;
+        std::memcpy(&result[first + c].operation, record, 4);
+        std::memcpy(&result[first + c].block, record + 4, sizeof(Block));
+    }
+
+    return true;
+}
+
+bool MapJournal::open(const std::string& filename, uint64_t mapHash)
+{
+    close();
+
+    std::vector <Record> records;
+    if ( !read(filename, mapHash, records) )
+        return restart(filename, mapHash, 0);
+
+    // Whole records only, a torn one at the end is cut away.
+    std::error_code error;
+    fs::resize_file(filename, journalHeaderSize + records.size() * journalRecordSize, error);
+
+    file = std::fopen(filename.c_str(), "ab");
+    if ( file == nullptr )
+        return false;
+
+    this->filename = filename;
+    recordCount = records.size();
+    return true;
+}
+
+void MapJournal::close()
+{
+    if ( file )
+        std::fclose(file);
+
+    file = nullptr;
+    filename.clear();
+    recordCount = 0;
+}
+
+void MapJournal::append(int operation, const Block& block)
+{
+    if ( file == nullptr )
+        return;
+
+    char record[journalRecordSize];
+    std::memcpy(record, &operation, 4);
+    std::memcpy(record + 4, &block, sizeof(Block));
+
+    // One write per record, the OS takes care of getting it to disk.
+    std::fwrite(record, 1, journalRecordSize, file);
+    std::fflush(file);
+    recordCount++;
+}
+
+void MapJournal::append(int operation, const Block *blocks, unsigned int count)
+{
+    if ( file == nullptr || count == 0 )
+        return;
+
+    std::vector <char> records(journalRecordSize * (size_t)count);
+    for ( unsigned int c = 0; c < count; c++ )
+    {
+        std::memcpy(&records[c * journalRecordSize], &operation, 4);
+        std::memcpy(&records[c * journalRecordSize + 4], &blocks[c], sizeof(Block));
+    }
+
+    std::fwrite(records.data(), 1, records.size(), file);
+    std::fflush(file);
+    recordCount += count;
+}
+
+bool MapJournal::restart(const std::string& filename, uint64_t mapHash, uint64_t firstRecord)
+{
+    std::vector <char> data = makeHeader(mapHash);
+    std::string oldFilename = this->filename;
+
+    // Records that came after the new map file was taken.
+    if ( file && firstRecord < recordCount )
+    {
+        MappedFile journal;
+        if ( journal.open(oldFilename) )
+        {
+            size_t begin = journalHeaderSize + firstRecord * journalRecordSize;
+            size_t end = std::min(journal.getSize(), journalHeaderSize + recordCount * journalRecordSize);
+            if ( begin < end )
+                data.insert(data.end(), journal.getData() + begin, journal.getData() + end);
+        }
+    }
+
+    close();
+
+    if ( !writeFileAtomic(filename, data.data(), data.size()) )
+        return false;
+
+    // The old journal is not needed by any map file now.
+    std::error_code error;
+    if ( !oldFilename.empty() && oldFilename != filename )
+        fs::remove(oldFilename, error);
+
+    file = std::fopen(filename.c_str(), "ab");
+    if ( file == nullptr )
+        return false;
+
+    this->filename = filename;
+    recordCount = (data.size() - journalHeaderSize) / journalRecordSize;
+    return true;
+}
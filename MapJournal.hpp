@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+
+#include "BlockPool.hpp"
+
+/*
+    Append only log of the edits made after the map file was written.
+
+    Journal file [ MaPJ ] = 0x4A50614D, next to the map file as
+    <map file>.journal
+
+    int [FileFormat Descriptor] = MaPJ (4 bytes)
+    int64 [Map file hash]              (8 bytes, hashMapFile of the map file)
+
+    [ record                           (20 bytes)
+        - int operation - 4 bytes (1 = add, 2 = remove)
+        - block data    - 16 bytes (same as in the map file)
+    ] * until the end of the file
+
+    Records are written without syncing, a torn record at the end is
+    ignored. A journal whose hash is not the map file's belongs to an
+    older map file and is never replayed.
+ */
+
+const int journalID = 0x4A50614D;      // MaPJ
+
+uint64_t hashMapFile(const char *data, size_t size);
+
+class MapJournal
+{
+public:
+    enum Operation { Add = 1, Remove = 2 };
+
+    struct Record
+    {
+        int operation;
+        Block block;
+    };
+
+    MapJournal() {}
+    MapJournal(const MapJournal&) = delete;
+    MapJournal& operator=(const MapJournal&) = delete;
+    ~MapJournal() { close(); }
+
+    // Records of the journal of the map file that hashes to mapHash.
+    static bool read(const std::string& filename, uint64_t mapHash, std::vector<Record>& result);
+
+    // Appends to the journal, a journal of some other map file is started over.
+    bool open(const std::string& filename, uint64_t mapHash);
+    void close();
+    bool isOpen() const { return file != nullptr; }
+
+    // Does nothing when the journal is not open.
+    void append(int operation, const Block& block);
+    // Same operation for count blocks in one write.
+    void append(int operation, const Block *blocks, unsigned int count);
+
+    const std::string& getFilename() const { return filename; }
+    uint64_t getRecordCount() const { return recordCount; }
+
+    // After the map was written to a new file: the journal moves next to it
+    // and keeps only the records from firstRecord on, the ones that are
+    // not in the new file.
+    bool restart(const std::string& filename, uint64_t mapHash, uint64_t firstRecord);
+
+private:
+    std::string filename;
+    std::FILE *file = nullptr;
+    uint64_t recordCount = 0;
+};
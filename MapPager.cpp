@@ -0,0 +1,298 @@
+#include "MapPager.hpp"
+#include <system_error>
+
+#ifdef linux
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+bool MapPager::open(const std::string& filename)
+{
+    close();
+
+    // v1 files have no chunks to page.
+    if ( !reader.open(filename) || reader.getVersion() != 2 )
+    {
+        reader.close();
+        return false;
+    }
+
+    this->filename = filename;
+    layout.create(reader.getInfo().width, reader.getInfo().height, reader.getChunkSize());
+    chunks.assign(layout.getCellCount(), Chunk());
+    setupPages();
+
+    stopping = false;
+    thread = std::thread(&MapPager::run, this);
+    return true;
+}
+
+bool MapPager::reopen(const std::string& filename)
+{
+    std::lock_guard <std::mutex> lock(fileMutex);
+
+    // The new file is checked before the old one is let go.
+    {
+        MapReader newFile;
+        if ( !newFile.open(filename) || newFile.getVersion() != 2 ||
+             newFile.getChunkSize() != layout.getCellSize() )
+            return false;
+    }
+
+    if ( !reader.open(filename) )
+        return false;
+
+    pagesFile.close();
+    std::error_code error;
+    fs::remove(this->filename + ".pages", error);
+
+    this->filename = filename;
+    setupPages();
+
+    // Everything that was edited is in the new file now.
+    for ( auto& chunk : chunks )
+        chunk.dirty = false;
+
+    return true;
+}
+
+void MapPager::close()
+{
+    if ( thread.joinable() )
+    {
+        {
+            std::lock_guard <std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueChanged.notify_all();
+        thread.join();
+    }
+
+    requests.clear();
+    loaded.clear();
+
+    if ( pagesFile.is_open() )
+    {
+        pagesFile.close();
+        std::error_code error;
+        fs::remove(filename + ".pages", error);
+    }
+
+    reader.close();
+    pages.clear();
+    chunks.clear();
+    residentChunks.clear();
+}
+
+void MapPager::setupPages()
+{
+    pages.assign(layout.getCellCount(), Page());
+    pagesSize = 0;
+
+    const auto& entries = reader.getChunks();
+    for ( unsigned int c = 0; c < entries.size(); c++ )
+    {
+        if ( entries[c].chunk >= layout.getCellCount() )
+            continue;
+
+        Page& page = pages[entries[c].chunk];
+        page.entry = c;
+        page.blockCount = entries[c].blockCount;
+        page.bounds = entries[c].bounds;
+    }
+}
+
+int MapPager::getBlockCount(int chunk) const
+{
+    return pages[chunk].blockCount;
+}
+
+BlockBounds MapPager::getBounds(int chunk) const
+{
+    return pages[chunk].bounds;
+}
+
+void MapPager::setState(int chunk, ChunkState state)
+{
+    Chunk& current = chunks[chunk];
+
+    if ( state == Resident && current.position == -1 )
+    {
+        current.position = residentChunks.size();
+        residentChunks.push_back(chunk);
+    }
+    else if ( state != Resident && current.position != -1 )
+    {
+        int last = residentChunks.back();
+        residentChunks[current.position] = last;
+        chunks[last].position = current.position;
+        residentChunks.pop_back();
+        current.position = -1;
+    }
+
+    current.state = state;
+}
+
+void MapPager::request(int chunk)
+{
+    if ( chunks[chunk].state != Unloaded )
+        return;
+
+    if ( getBlockCount(chunk) == 0 )
+    {
+        setState(chunk, Resident);
+        return;
+    }
+
+    setState(chunk, Loading);
+
+    {
+        std::lock_guard <std::mutex> lock(queueMutex);
+        requests.push_back({chunk, ++chunks[chunk].loadId});
+    }
+    queueChanged.notify_one();
+}
+
+void MapPager::clearRequests()
+{
+    std::lock_guard <std::mutex> lock(queueMutex);
+
+    for ( const auto& waiting : requests )
+        if ( chunks[waiting.chunk].loadId == waiting.loadId )
+            setState(waiting.chunk, Unloaded);
+
+    requests.clear();
+}
+
+bool MapPager::takeLoaded(LoadedChunk& result)
+{
+    std::lock_guard <std::mutex> lock(queueMutex);
+
+    while ( !loaded.empty() )
+    {
+        result = std::move(loaded.front());
+        loaded.pop_front();
+
+        Chunk& chunk = chunks[result.chunk];
+        if ( chunk.state == Loading && chunk.loadId == result.loadId )
+        {
+            setState(result.chunk, Resident);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void MapPager::load(int chunk, std::vector<Block>& result)
+{
+    if ( chunks[chunk].state == Resident )
+        return;
+
+    // A load on the way is stale after this.
+    chunks[chunk].loadId++;
+
+    readChunk(chunk, result);
+    setState(chunk, Resident);
+}
+
+void MapPager::readChunk(int chunk, std::vector<Block>& result)
+{
+    std::lock_guard <std::mutex> lock(fileMutex);
+    readStored(chunk, result);
+}
+
+void MapPager::readStored(int chunk, std::vector<Block>& result)
+{
+    const Page& page = pages[chunk];
+
+    if ( page.written )
+    {
+        size_t first = result.size();
+        result.resize(first + page.blockCount);
+
+        pagesFile.seekg(page.offset);
+        pagesFile.read((char*)&result[first], page.blockCount * sizeof(Block));
+        if ( !pagesFile )
+        {
+            pagesFile.clear();
+            result.resize(first);
+        }
+    }
+    else if ( page.entry != -1 )
+        reader.readChunk(page.entry, result);
+}
+
+bool MapPager::evict(int chunk, const Block *blocks, unsigned int count, const BlockBounds& bounds)
+{
+    if ( chunks[chunk].state != Resident )
+        return false;
+
+    if ( chunks[chunk].dirty )
+    {
+        std::lock_guard <std::mutex> lock(fileMutex);
+
+        if ( !pagesFile.is_open() )
+        {
+            pagesFile.open(filename + ".pages", std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+            if ( !pagesFile.is_open() )
+                return false;
+        }
+
+        // Pages are only appended, an older copy of the chunk just stays unused.
+        pagesFile.seekp(pagesSize);
+        pagesFile.write((const char*)blocks, count * sizeof(Block));
+        pagesFile.flush();
+        if ( !pagesFile )
+        {
+            pagesFile.clear();
+            return false;
+        }
+
+        Page& page = pages[chunk];
+        page.written = true;
+        page.offset = pagesSize;
+        page.blockCount = count;
+        page.bounds = bounds;
+        pagesSize += count * sizeof(Block);
+
+        chunks[chunk].dirty = false;
+    }
+
+    setState(chunk, Unloaded);
+    return true;
+}
+
+void MapPager::run()
+{
+    while ( true )
+    {
+        Request next;
+        {
+            std::unique_lock <std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return stopping || !requests.empty(); });
+
+            if ( stopping )
+                return;
+
+            next = requests.front();
+            requests.pop_front();
+        }
+
+        LoadedChunk result;
+        result.chunk = next.chunk;
+        result.loadId = next.loadId;
+        {
+            std::lock_guard <std::mutex> lock(fileMutex);
+            readStored(next.chunk, result.blocks);
+        }
+
+        std::lock_guard <std::mutex> lock(queueMutex);
+        loaded.push_back(std::move(result));
+    }
+}
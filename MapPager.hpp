@@ -0,0 +1,124 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+#include "MapFormat.hpp"
+#include "GridLayout.hpp"
+
+/*
+    Chunks of a v2 map file for maps that are not kept in memory at once.
+
+    Chunks are read on a background thread after request() and picked up
+    with takeLoaded() on the main thread. A chunk that is evicted after
+    edits is appended to filename.pages, later loads of the chunk read it
+    from there. After the map has been saved, reopen() starts again from
+    the new file and the pages file is dropped.
+
+    Chunk states are only touched on the main thread. Every load has an id,
+    so a result that was overtaken by load() or evict() is thrown away.
+ */
+
+class MapPager
+{
+public:
+    enum ChunkState { Unloaded, Loading, Resident };
+
+    struct LoadedChunk
+    {
+        int chunk = -1;
+        uint32_t loadId = 0;
+        std::vector <Block> blocks;
+    };
+
+    ~MapPager() { close(); }
+
+    bool open(const std::string& filename);
+    bool reopen(const std::string& filename);
+    void close();
+    bool isOpen() const { return !chunks.empty(); }
+
+    const MapFile& getInfo() const { return reader.getInfo(); }
+    const GridLayout& getLayout() const { return layout; }
+
+    ChunkState getState(int chunk) const { return chunks[chunk].state; }
+    const std::vector<int>& getResidentChunks() const { return residentChunks; }
+
+    // Stored block count and bounds of the chunk, from the pages file when
+    // the chunk has been written there.
+    int getBlockCount(int chunk) const;
+    BlockBounds getBounds(int chunk) const;
+
+    // Queues the chunk to be loaded. Empty chunks are resident right away.
+    void request(int chunk);
+    // Drops the requests the thread has not started yet.
+    void clearRequests();
+    // Next finished load, the chunk is resident after this.
+    bool takeLoaded(LoadedChunk& result);
+
+    // Loads the chunk right away and appends its blocks to result.
+    void load(int chunk, std::vector<Block>& result);
+    // Stored blocks of the chunk without changing its state.
+    void readChunk(int chunk, std::vector<Block>& result);
+
+    void markDirty(int chunk) { chunks[chunk].dirty = true; }
+    bool isDirty(int chunk) const { return chunks[chunk].dirty; }
+
+    // blocks are the resident blocks of the chunk, written back when dirty.
+    bool evict(int chunk, const Block *blocks, unsigned int count, const BlockBounds& bounds);
+
+private:
+    struct Chunk
+    {
+        ChunkState state = Unloaded;
+        bool dirty = false;
+        uint32_t loadId = 0;
+        int position = -1;              // In residentChunks
+    };
+
+    struct Page
+    {
+        int entry = -1;                 // Directory entry in the map file
+        bool written = false;           // Newer blocks are in the pages file
+        uint64_t offset = 0;
+        int blockCount = 0;
+        BlockBounds bounds;
+    };
+
+    struct Request
+    {
+        int chunk;
+        uint32_t loadId;
+    };
+
+    void setState(int chunk, ChunkState state);
+    void readStored(int chunk, std::vector<Block>& result);   // Needs fileMutex
+    void setupPages();
+    void run();
+
+    std::string filename;
+    MapReader reader;
+    GridLayout layout;
+
+    std::vector <Chunk> chunks;
+    std::vector <int> residentChunks;
+
+    // Shared with the thread
+    std::mutex fileMutex;               // reader, pages and pagesFile
+    std::vector <Page> pages;
+    std::fstream pagesFile;
+    uint64_t pagesSize = 0;
+
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    std::deque <Request> requests;
+    std::deque <LoadedChunk> loaded;
+    bool stopping = false;
+
+    std::thread thread;
+};
@@ -0,0 +1,65 @@
+#include "MapSaver.hpp"
+#include "AtomicWrite.hpp"
+#include "MapJournal.hpp"
+#include <algorithm>
+
+const size_t saveSliceSize = 4 * 1024 * 1024;   // Bytes written between progress updates
+
+bool MapSaver::start(const std::string& filename, const MapFile& info, std::vector<Block>&& blocks,
+                     std::vector<BlockBounds>&& bounds, int chunkSize)
+{
+    if ( isRunning() )
+        return false;
+
+    this->filename  = filename;
+    this->info      = info;
+    this->blocks    = std::move(blocks);
+    this->bounds    = std::move(bounds);
+    this->chunkSize = chunkSize;
+
+    progress = 0;
+    finished = false;
+    succeeded = false;
+
+    thread = std::thread(&MapSaver::run, this);
+    return true;
+}
+
+bool MapSaver::finish()
+{
+    if ( !thread.joinable() )
+        return false;
+
+    thread.join();
+
+    blocks.clear();
+    blocks.shrink_to_fit();
+    bounds.clear();
+    bounds.shrink_to_fit();
+
+    return succeeded;
+}
+
+void MapSaver::run()
+{
+    std::vector <char> buffer = writeMapV2(info, blocks.data(), blocks.size(), chunkSize, bounds.data());
+    fileHash = hashMapFile(buffer.data(), buffer.size());
+    progress = 10;
+
+    AtomicFileWriter writer;
+    succeeded = writer.open(filename);
+
+    size_t written = 0;
+    while ( succeeded && written < buffer.size() )
+    {
+        size_t size = std::min(saveSliceSize, buffer.size() - written);
+        succeeded = writer.write(buffer.data() + written, size);
+        written += size;
+
+        progress = 10 + (int)(85 * written / buffer.size());
+    }
+
+    succeeded = succeeded && writer.commit(true);
+    progress = 100;
+    finished = true;
+}
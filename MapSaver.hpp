@@ -0,0 +1,49 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+#include "MapFormat.hpp"
+
+/*
+    Writes a map file on a background thread.
+
+    start() takes a copy of the blocks and their bounds, so the map can be
+    edited while the copy is serialized and written. The main thread polls
+    isFinished() and collects the result with finish().
+ */
+
+class MapSaver
+{
+public:
+    ~MapSaver() { finish(); }
+
+    // Returns false when a save is already running.
+    bool start(const std::string& filename, const MapFile& info, std::vector<Block>&& blocks,
+               std::vector<BlockBounds>&& bounds, int chunkSize);
+
+    bool isRunning() const { return thread.joinable(); }
+    bool isFinished() const { return finished; }
+    int getProgress() const { return progress; }      // Percent
+    const std::string& getFilename() const { return filename; }
+    uint64_t getFileHash() const { return fileHash; }    // hashMapFile of the written file
+
+    // Waits for the thread, returns whether the file was written.
+    bool finish();
+
+private:
+    void run();
+
+    std::string filename;
+    MapFile info;
+    std::vector <Block> blocks;
+    std::vector <BlockBounds> bounds;
+    int chunkSize = 0;
+    uint64_t fileHash = 0;
+
+    std::thread thread;
+    std::atomic <int> progress{0};
+    std::atomic <bool> finished{false};
+    bool succeeded = false;
+};
@@ -0,0 +1,104 @@
+#include "MappedFile.hpp"
+#include <fstream>
+
+#ifdef linux
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+#endif
+
+bool MappedFile::open(const std::string& filename)
+{
+    close();
+
+#ifdef linux
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if ( fd == -1 )
+        return false;
+
+    struct stat fileStat;
+    if ( fstat(fd, &fileStat) == 0 && fileStat.st_size > 0 )
+    {
+        void *address = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if ( address != MAP_FAILED )
+        {
+            madvise(address, fileStat.st_size, MADV_SEQUENTIAL);
+            data = (const char *)address;
+            size = fileStat.st_size;
+            mapped = true;
+        }
+    }
+    ::close(fd);
+
+    if ( mapped )
+        return true;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE windowsFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                                     FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if ( windowsFile == INVALID_HANDLE_VALUE )
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if ( GetFileSizeEx(windowsFile, &fileSize) && fileSize.QuadPart > 0 )
+    {
+        HANDLE mapping = CreateFileMappingA(windowsFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if ( mapping )
+        {
+            void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if ( address )
+            {
+                data = (const char *)address;
+                size = fileSize.QuadPart;
+                fileHandle = windowsFile;
+                mappingHandle = mapping;
+                mapped = true;
+                return true;
+            }
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(windowsFile);
+#endif
+
+    // No mapping, read the whole file at once.
+    std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
+    if ( !file.is_open() )
+        return false;
+
+    buffer.resize(file.tellg());
+    file.seekg(0);
+    file.read(buffer.data(), buffer.size());
+
+    data = buffer.data();
+    size = file ? buffer.size() : 0;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if ( mapped )
+    {
+#ifdef linux
+        munmap((void *)data, size);
+#endif
+#if defined(_WIN32) || defined(_WIN64)
+        UnmapViewOfFile(data);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+#endif
+    }
+
+    buffer.clear();
+    data = nullptr;
+    size = 0;
+    fileHandle = nullptr;
+    mappingHandle = nullptr;
+    mapped = false;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+
+// Read only view of a whole file. Memory mapped where the platform has it,
+// otherwise the file is read to memory with one read.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& filename);
+    void close();
+
+    const char *getData() const { return data; }
+    size_t getSize() const { return size; }
+
+private:
+    const char *data = nullptr;
+    size_t size = 0;
+
+    void *fileHandle = nullptr;         // Windows file and mapping handles
+    void *mappingHandle = nullptr;
+    bool mapped = false;
+
+    std::vector <char> buffer;          // Used when the file could not be mapped
+};
@@ -1,20 +1,163 @@
 #include "Resources.hpp"
 #include "Console.hpp"
+#include "AtlasPacker.hpp"
+#include "BlockCache.hpp"
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 Resources::~Resources()
 {
     for(auto& texture : blockTextures)
     {
-        if ( texture.second )
-            delete texture.second;
+        if ( texture.second.texture )
+            delete texture.second.texture;
     }
+
+    for(auto& page : atlasPages)
+        delete page.texture;
 }
 
 sf::Texture *Resources::getTexture(int id)
 {
-    if ( blockTextures.find(id) != blockTextures.end() )
-        return blockTextures[id];
-    
+    auto it = blockTextures.find(id);
+    if ( it == blockTextures.end() )
+        return nullptr;
+
+    BlockTextureEntry& entry = it->second;
+
+    if ( entry.loaded )
+    {
+        textureUse.splice(textureUse.begin(), textureUse, entry.lastUse);
+        return entry.texture;
+    }
+
+    if ( !entry.texture->loadFromFile(entry.filename) )
+    {
+        console->addLogLine("\tError: Can't load " + entry.filename);
+        return entry.texture;
+    }
+
+    entry.loaded = true;
+    textureUse.push_front({false, id});
+    entry.lastUse = textureUse.begin();
+
+    loadedTextureBytes += (size_t)entry.size.x * entry.size.y * 4;
+    texturesLoaded++;
+
+    evictTextures(entry.texture);
+    return entry.texture;
+}
+
+sf::Texture *Resources::getAtlasPage(int index)
+{
+    if ( index < 0 || index >= (int)atlasPages.size() )
+        return nullptr;
+
+    AtlasPage& page = atlasPages[index];
+
+    if ( page.loaded )
+    {
+        textureUse.splice(textureUse.begin(), textureUse, page.lastUse);
+        return page.texture;
+    }
+
+    if ( !page.texture->create(page.size.x, page.size.y) )
+    {
+        console->addLogLine("\tError: Can't create atlas page " + std::to_string(index));
+        return page.texture;
+    }
+
+    // Pixels go to the GPU straight from the mapped file.
+    page.texture->update(page.pixels ? page.pixels : page.image.getPixelsPtr());
+
+    page.loaded = true;
+    textureUse.push_front({true, index});
+    page.lastUse = textureUse.begin();
+
+    loadedTextureBytes += (size_t)page.size.x * page.size.y * 4;
+    texturesLoaded++;
+
+    evictTextures(page.texture);
+    return page.texture;
+}
+
+sf::Vector2u Resources::getTextureSize(int id)
+{
+    auto it = blockTextures.find(id);
+    return it != blockTextures.end() ? it->second.size : sf::Vector2u();
+}
+
+void Resources::evictTextures(const sf::Texture *keep)
+{
+    unsigned int evicted = 0;
+
+    while ( loadedTextureBytes > textureBudget && !textureUse.empty() )
+    {
+        const TextureUse& use = textureUse.back();
+        sf::Texture *texture;
+        sf::Vector2u size;
+        bool *loaded;
+
+        if ( use.atlasPage )
+        {
+            AtlasPage& page = atlasPages[use.index];
+            texture = page.texture;
+            size = page.size;
+            loaded = &page.loaded;
+        }
+        else
+        {
+            BlockTextureEntry& entry = blockTextures[use.index];
+            texture = entry.texture;
+            size = entry.size;
+            loaded = &entry.loaded;
+        }
+
+        // The texture just asked for stays even when it alone is over the budget.
+        if ( texture == keep )
+            break;
+
+        // Swapping with an empty texture frees the pixels and keeps the object.
+        sf::Texture empty;
+        texture->swap(empty);
+        *loaded = false;
+
+        loadedTextureBytes -= (size_t)size.x * size.y * 4;
+        textureUse.pop_back();
+        evicted++;
+    }
+
+    if ( evicted > 0 )
+    {
+        texturesEvicted += evicted;
+        console->addLogLine("\tEvicted " + std::to_string(evicted) + " textures, " +
+                            std::to_string(textureUse.size()) + " loaded.");
+    }
+}
+
+void Resources::logTextureStats()
+{
+    unsigned int pagesLoaded = 0;
+    for ( const auto& page : atlasPages )
+        pagesLoaded += page.loaded;
+
+    console->addLogLine("\tBlock textures: " + std::to_string(textureUse.size() - pagesLoaded) + " of " +
+                        std::to_string(blockTextures.size()) + " loaded, atlas pages: " +
+                        std::to_string(pagesLoaded) + " of " + std::to_string(atlasPages.size()) + " loaded, " +
+                        std::to_string(loadedTextureBytes / (1024*1024)) + " / " +
+                        std::to_string(textureBudget / (1024*1024)) + " MB.");
+    console->addLogLine("\tLoaded " + std::to_string(texturesLoaded) + " and evicted " +
+                        std::to_string(texturesEvicted) + " textures since startup.");
+}
+
+const AtlasRegion *Resources::getAtlasRegion(int id)
+{
+    if ( id >= 0 && id < (int)atlasRegions.size() && atlasRegions[id].page != -1 )
+        return &atlasRegions[id];
+
     return nullptr;
 }
 
@@ -63,39 +206,260 @@ int Resources::getPrevKeyFromTexture(int id)
 
 void Resources::loadBlocks(std::string directory)
 {
+    std::vector <BlockCacheEntry> files;
+
     console->addLogLine("Loading blocks...");
 //    std::cout << "Loading blocks..." << std::endl;
     for(auto& p : fs::directory_iterator(directory) )
     {
-        std::string str;
-        sf::Texture *texture = nullptr;
         fs::path path;
         std::string pathAndFilename;
-        std::string name;
         std::string filename;
         std::string id;
         size_t idPositionEnd = 0;
+        std::error_code error;
         path = p;
         pathAndFilename = path.string();
        
         filename = pathAndFilename.substr(pathAndFilename.find_last_of("/\\")+1);
         idPositionEnd = filename.find_first_of('_');
         id = filename.substr(0, idPositionEnd);
-        name = filename.substr(idPositionEnd+1, filename.find_last_of('.')-(idPositionEnd+1));
 
-        str = "\t";
-        str += id + "\t = ";
-        str += pathAndFilename;
+        BlockCacheEntry file;
+        file.id = stoi(id);
+        file.path = pathAndFilename;
+        file.name = filename.substr(idPositionEnd+1, filename.find_last_of('.')-(idPositionEnd+1));
+        file.fileSize = fs::file_size(path, error);
+        file.modified = fs::last_write_time(path, error).time_since_epoch().count();
+        files.push_back(file);
+    }
+
+    // Directory order can change between runs, the cache is in path order.
+    std::sort(files.begin(), files.end(), [](const BlockCacheEntry& a, const BlockCacheEntry& b) {
+        return a.path < b.path;
+    });
+
+    if ( loadBlockCache(files) )
+    {
+        console->addLogLine("\tLoaded " + std::to_string(files.size()) + " blocks from " + blockCacheFile + ".");
+        console->addLogLine("Block loading is done.");
+        return;
+    }
+
+    // PNG decoding is spread to worker threads. Images are only needed for the atlas,
+    // block textures are loaded when they are first used.
+    std::vector <sf::Image> decodedImages(files.size());
+    std::vector <int> states(files.size(), 0);     // 0 = decoding, 1 = decoded, 2 = failed
+    std::mutex stateMutex;
+    std::condition_variable decoded;
+    std::atomic <unsigned int> nextFile{0};
+
+    unsigned int threadCount = std::max(1u, std::min<unsigned int>(std::thread::hardware_concurrency(), files.size()));
+    std::vector <std::thread> workers;
+
+    console->addLogLine("\tDecoding " + std::to_string(files.size()) + " images on " + std::to_string(threadCount) + " threads.");
+
+    for ( unsigned int t = 0; t < threadCount; t++ )
+    {
+        workers.emplace_back([&files, &decodedImages, &states, &nextFile, &stateMutex, &decoded]() {
+            for ( unsigned int c = nextFile++; c < files.size(); c = nextFile++ )
+            {
+                bool loaded = decodedImages[c].loadFromFile(files[c].path);
+
+                std::lock_guard <std::mutex> lock(stateMutex);
+                states[c] = loaded ? 1 : 2;
+                decoded.notify_all();
+            }
+        });
+    }
+
+    std::vector <std::pair<int, sf::Image>> images;
+    images.reserve(files.size());
+
+    for ( unsigned int c = 0; c < files.size(); c++ )
+    {
+        {
+            std::unique_lock <std::mutex> lock(stateMutex);
+            decoded.wait(lock, [&states, c]() { return states[c] != 0; });
+        }
+
+        std::string str = "\t";
+        str += std::to_string(files[c].id) + "\t = ";
+        str += files[c].path;
 //        std::cout << "\t" << id << "\t= " << pathAndFilename << std::endl;
         console->addLogLine(str);
 
-        texture = new sf::Texture();
-        texture->loadFromFile(pathAndFilename);
-        blockTextures.emplace(stoi(id), texture);
+        if ( states[c] == 2 )
+        {
+            console->addLogLine("\tError: Can't load " + files[c].path);
+            continue;
+        }
+
+        files[c].size = decodedImages[c].getSize();
+        addBlockTexture(files[c]);
+
+        images.emplace_back(files[c].id, std::move(decodedImages[c]));
+    }
+
+    for ( auto& worker : workers )
+        worker.join();
+
+    int firstPage = atlasPages.size();
+    std::vector <sf::Image> pageImages;
+    buildAtlas(images, pageImages);
+
+    // Next start can skip the decoding if nothing changes.
+    for ( unsigned int c = 0; c < files.size(); c++ )
+    {
+        const AtlasRegion *region = getAtlasRegion(files[c].id);
+        if ( states[c] != 1 || region == nullptr )
+            continue;
+
+        files[c].page = region->page - firstPage;
+        files[c].position = {(unsigned int)region->rect.left, (unsigned int)region->rect.top};
+    }
+
+    bool written = BlockCache::write(blockCacheFile, getAtlasPageSize(), files, pageImages);
+    if ( !written )
+        console->addLogLine("\tError: Can't write " + blockCacheFile);
+
+    // Pages are read from the cache file when they are drawn, without it they stay in memory.
+    blockCaches.emplace_back();
+    BlockCache& cache = blockCaches.back();
+
+    if ( written && cache.open(blockCacheFile) && cache.getPages().size() == pageImages.size() )
+    {
+        for ( const auto& cachedPage : cache.getPages() )
+            addAtlasPage(cachedPage.size, cachedPage.pixels);
     }
+    else
+    {
+        blockCaches.pop_back();
+        for ( auto& pageImage : pageImages )
+        {
+            addAtlasPage(pageImage.getSize(), nullptr);
+            atlasPages.back().image = pageImage;
+        }
+    }
+
     console->addLogLine("Block loading is done.");
 }
 
+bool Resources::loadBlockCache(const std::vector<BlockCacheEntry>& files)
+{
+    // Kept open, pages are uploaded from it when they are drawn.
+    blockCaches.emplace_back();
+    BlockCache& cache = blockCaches.back();
+
+    bool valid = cache.open(blockCacheFile) && cache.getPageSize() == getAtlasPageSize() &&
+                 cache.getEntries().size() == files.size();
+
+    // Any added, removed or changed file makes the whole cache old.
+    for ( unsigned int c = 0; c < files.size() && valid; c++ )
+    {
+        const BlockCacheEntry& entry = cache.getEntries()[c];
+        if ( entry.path != files[c].path || entry.id != files[c].id ||
+             entry.fileSize != files[c].fileSize || entry.modified != files[c].modified )
+            valid = false;
+    }
+
+    if ( !valid )
+    {
+        blockCaches.pop_back();
+        return false;
+    }
+
+    int firstPage = atlasPages.size();
+
+    for ( const auto& cachedPage : cache.getPages() )
+        addAtlasPage(cachedPage.size, cachedPage.pixels);
+
+    for ( const auto& entry : cache.getEntries() )
+    {
+        if ( entry.page == -1 )
+        {
+            console->addLogLine("\tError: Can't load " + entry.path);
+            continue;
+        }
+
+        addBlockTexture(entry);
+
+        if ( entry.id >= (int)atlasRegions.size() )
+            atlasRegions.resize(entry.id+1);
+
+        atlasRegions[entry.id].page = firstPage + entry.page;
+        atlasRegions[entry.id].rect = {(int)entry.position.x, (int)entry.position.y, (int)entry.size.x, (int)entry.size.y};
+    }
+
+    return true;
+}
+
+void Resources::addBlockTexture(const BlockCacheEntry& file)
+{
+    BlockTextureEntry& entry = blockTextures[file.id];
+    if ( entry.texture == nullptr )
+        entry.texture = new sf::Texture();
+
+    entry.filename = file.path;
+    entry.name = file.name;
+    entry.size = file.size;
+}
+
+std::string Resources::getBlockName(int id)
+{
+    auto it = blockTextures.find(id);
+    return it != blockTextures.end() ? it->second.name : std::string();
+}
+
+void Resources::buildAtlas(std::vector<std::pair<int, sf::Image>>& images, std::vector<sf::Image>& pageImages)
+{
+    unsigned int pageSize = getAtlasPageSize();
+    AtlasPacker packer(pageSize, pageSize, 1, sf::Texture::getMaximumSize());
+    std::vector <sf::Vector2u> sizes;
+
+    for ( auto& image : images )
+        sizes.push_back(image.second.getSize());
+
+    std::vector <AtlasPacker::Placement> placements = packer.pack(sizes);
+    pageImages.resize(packer.getPageSizes().size());
+
+    for ( unsigned int c = 0; c < pageImages.size(); c++ )
+        pageImages[c].create(packer.getPageSizes()[c].x, packer.getPageSizes()[c].y, sf::Color::Transparent);
+
+    for ( unsigned int c = 0; c < images.size(); c++ )
+    {
+        int id = images[c].first;
+        AtlasPacker::Placement& placement = placements[c];
+
+        if ( placement.page == -1 )
+        {
+            console->addLogLine("\tError: Block " + std::to_string(id) + " is " + std::to_string(sizes[c].x) + "x" +
+                                std::to_string(sizes[c].y) + ", over the biggest texture size " +
+                                std::to_string(sf::Texture::getMaximumSize()) + ".");
+            continue;
+        }
+
+        pageImages[placement.page].copy(images[c].second, placement.x, placement.y);
+
+        if ( id >= (int)atlasRegions.size() )
+            atlasRegions.resize(id+1);
+
+        atlasRegions[id].page = atlasPages.size() + placement.page;
+        atlasRegions[id].rect = {(int)placement.x, (int)placement.y, (int)sizes[c].x, (int)sizes[c].y};
+    }
+
+    console->addLogLine("\tPacked " + std::to_string(images.size()) + " blocks to " + 
+                        std::to_string(pageImages.size()) + " atlas pages.");
+}
+
+void Resources::addAtlasPage(sf::Vector2u size, const sf::Uint8 *pixels)
+{
+    atlasPages.emplace_back();
+    atlasPages.back().texture = new sf::Texture();
+    atlasPages.back().size = size;
+    atlasPages.back().pixels = pixels;
+}
+
 bool Resources::loadFont(std::string filename)
 {
     sf::Font *font = new sf::Font;
@@ -3,6 +3,10 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <list>
+#include <algorithm>
+
+#include "BlockCache.hpp"
 
 #ifdef linux
 #include <filesystem>
@@ -20,6 +24,49 @@ struct TextureData
     std::string name;
 };
 
+// Where the block image is in the atlas.
+struct AtlasRegion
+{
+    int page = -1;
+    sf::IntRect rect;
+};
+
+const unsigned int atlasPageSize = 4096;
+const std::string blockCacheFile = "blocks.cache";     // Decoded blocks, see BlockCache.hpp
+const size_t defaultTextureBudget = 256 * 1024 * 1024;     // Bytes of block textures and atlas pages kept loaded
+
+// Loaded texture in the use order of the texture budget.
+struct TextureUse
+{
+    bool atlasPage;
+    int index;                              // Atlas page or block id
+};
+
+// Block texture that is loaded when it is first asked for. The texture
+// object itself is never deleted, so pointers to it stay valid; it is only
+// emptied when evicted and loaded again on the next getTexture.
+struct BlockTextureEntry
+{
+    sf::Texture *texture = nullptr;
+    std::string filename;
+    std::string name;                       // From the NN_name.png filename
+    sf::Vector2u size;                      // Known even when not loaded
+    bool loaded = false;
+    std::list <TextureUse>::iterator lastUse;   // In textureUse when loaded
+};
+
+// Atlas page that is uploaded when it is first drawn, and evicted over the
+// texture budget like the block textures.
+struct AtlasPage
+{
+    sf::Texture *texture = nullptr;         // Never deleted, only emptied like the block textures
+    sf::Vector2u size;
+    const sf::Uint8 *pixels = nullptr;      // In the mapped block cache
+    sf::Image image;                        // Pixels when there is no block cache
+    bool loaded = false;
+    std::list <TextureUse>::iterator lastUse;
+};
+
 // Keeps all usefull data on one place.
 class Resources
 {
@@ -29,7 +76,18 @@ public:
 
     void loadBlocks(std::string directory);
 
+    // Loads the texture if needed and evicts the least recently used textures
+    // and atlas pages over the texture budget. nullptr when there is no such block.
     sf::Texture *getTexture(int id);
+    sf::Vector2u getTextureSize(int id);
+    std::string getBlockName(int id);
+
+    void setTextureBudget(size_t bytes) { textureBudget = bytes; }
+    void logTextureStats();
+    const AtlasRegion *getAtlasRegion(int id);
+    // Same as getTexture, so only the pages that are drawn take memory.
+    sf::Texture *getAtlasPage(int page);
+    int getAtlasPageCount() { return atlasPages.size(); }
     int getNextKeyFromTexture(int id, int howManyKeysNeedToBeAfter = 0);
     int getPrevKeyFromTexture(int id);
 
@@ -80,7 +138,22 @@ public:
     }
 
 private:
-    std::map <int, sf::Texture *> blockTextures;
+    bool loadBlockCache(const std::vector<BlockCacheEntry>& files);
+    void addBlockTexture(const BlockCacheEntry& file);
+    void buildAtlas(std::vector<std::pair<int, sf::Image>>& images, std::vector<sf::Image>& pageImages);
+    unsigned int getAtlasPageSize() { return std::min(atlasPageSize, sf::Texture::getMaximumSize()); }
+    void addAtlasPage(sf::Vector2u size, const sf::Uint8 *pixels);
+    void evictTextures(const sf::Texture *keep);
+
+    std::map <int, BlockTextureEntry> blockTextures;
+    std::list <TextureUse> textureUse;      // Loaded textures, most recently used first
+    size_t textureBudget = defaultTextureBudget;
+    size_t loadedTextureBytes = 0;
+    unsigned int texturesLoaded = 0;        // Since startup, atlas pages too
+    unsigned int texturesEvicted = 0;
+    std::vector <AtlasPage> atlasPages;
+    std::list <BlockCache> blockCaches;     // Mapped pixels of the atlas pages
+    std::vector <AtlasRegion> atlasRegions;     // By block id
     std::vector <sf::Font *> fonts;
     
     int windowWidth = 0;
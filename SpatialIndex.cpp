@@ -0,0 +1,167 @@
+#include "SpatialIndex.hpp"
+#include <algorithm>
+
+void SpatialIndex::create(int width, int height, int cellSize)
+{
+    this->cellSize = cellSize > 0 ? cellSize : 1;
+
+    int biggestSide = std::max(std::max(width, height), 1);
+    int levelCellSize = this->cellSize;
+
+    levels.clear();
+    while ( true )
+    {
+        levels.emplace_back();
+        levels.back().create(width, height, levelCellSize);
+
+        if ( levelCellSize >= biggestSide )
+            break;
+
+        levelCellSize *= 2;
+    }
+
+    clear();
+}
+
+void SpatialIndex::clear()
+{
+    for ( auto& level : levels )
+        level.clear();
+
+    itemBounds.clear();
+    itemLevel.clear();
+}
+
+int SpatialIndex::getLevelFor(const BlockBounds& bounds) const
+{
+    float biggestSide = std::max(bounds.right - bounds.left, bounds.bottom - bounds.top);
+
+    // Bounds fit the loose cell when the block is at most one cell wide.
+    int level = 0;
+    float levelCellSize = cellSize;
+    while ( level < (int)levels.size()-1 && biggestSide > levelCellSize )
+    {
+        levelCellSize *= 2.0f;
+        level++;
+    }
+
+    return level;
+}
+
+void SpatialIndex::build(const std::vector<BlockBounds>& bounds)
+{
+    itemBounds = bounds;
+    itemLevel.assign(bounds.size(), 0);
+
+    for ( uint32_t c = 0; c < bounds.size(); c++ )
+        if ( !bounds[c].isEmpty() )
+            itemLevel[c] = getLevelFor(bounds[c]);
+
+    for ( unsigned int level = 0; level < levels.size(); level++ )
+        rebuildLevel(level);
+}
+
+void SpatialIndex::rebuildLevel(int level)
+{
+    BlockGrid& grid = levels[level];
+    std::vector <int> itemCells(itemBounds.size(), -1);
+
+    for ( uint32_t c = 0; c < itemBounds.size(); c++ )
+    {
+        const BlockBounds& bounds = itemBounds[c];
+        if ( !bounds.isEmpty() && itemLevel[c] == level )
+            itemCells[c] = grid.getCell((bounds.left + bounds.right)/2.0f, (bounds.top + bounds.bottom)/2.0f);
+    }
+
+    grid.build(itemCells, itemBounds);
+}
+
+void SpatialIndex::insert(uint32_t item, const BlockBounds& bounds)
+{
+    if ( item >= itemBounds.size() )
+    {
+        itemBounds.resize(item+1);
+        itemLevel.resize(item+1, 0);
+    }
+
+    int level = getLevelFor(bounds);
+    itemBounds[item] = bounds;
+    itemLevel[item] = level;
+
+    // Full cell just marks the level dirty, it is rebuilt on the next query.
+    BlockGrid& grid = levels[level];
+    grid.insert(grid.getCell((bounds.left + bounds.right)/2.0f, (bounds.top + bounds.bottom)/2.0f), item, bounds);
+}
+
+void SpatialIndex::insert(const std::vector<uint32_t>& items, const std::vector<BlockBounds>& bounds)
+{
+    uint32_t itemCount = itemBounds.size();
+    for ( uint32_t item : items )
+        itemCount = std::max(itemCount, item+1);
+
+    itemBounds.resize(itemCount);
+    itemLevel.resize(itemCount, 0);
+
+    // Once a level runs out of slack the rest only marks it, it is rebuilt once on the next query.
+    for ( uint32_t c = 0; c < items.size(); c++ )
+        insert(items[c], bounds[c]);
+}
+
+void SpatialIndex::remove(uint32_t item)
+{
+    if ( item >= itemBounds.size() || itemBounds[item].isEmpty() )
+        return;
+
+    levels[itemLevel[item]].remove(item);
+    itemBounds[item] = BlockBounds();
+}
+
+void SpatialIndex::update(const std::vector<uint32_t>& items, const std::vector<BlockBounds>& bounds)
+{
+    movedItems.clear();
+
+    for ( uint32_t c = 0; c < items.size(); c++ )
+    {
+        uint32_t item = items[c];
+        const BlockBounds& itemNewBounds = bounds[c];
+
+        if ( item < itemBounds.size() && !itemBounds[item].isEmpty() && itemLevel[item] == getLevelFor(itemNewBounds) )
+        {
+            BlockGrid& grid = levels[itemLevel[item]];
+            int cell = grid.getCell((itemNewBounds.left + itemNewBounds.right)/2.0f, (itemNewBounds.top + itemNewBounds.bottom)/2.0f);
+
+            if ( grid.update(cell, item, itemNewBounds) )
+            {
+                itemBounds[item] = itemNewBounds;
+                continue;
+            }
+        }
+
+        remove(item);
+        movedItems.push_back(c);
+    }
+
+    for ( uint32_t c : movedItems )
+        insert(items[c], bounds[c]);
+}
+
+void SpatialIndex::query(const BlockBounds& area, std::vector<uint32_t>& result)
+{
+    for ( unsigned int level = 0; level < levels.size(); level++ )
+    {
+        BlockGrid& grid = levels[level];
+
+        if ( grid.isDirty() )
+            rebuildLevel(level);
+
+        if ( level == levels.size()-1 )
+        {
+            grid.query(0, 0, grid.getColumns()-1, grid.getRows()-1, area, result);
+            continue;
+        }
+
+        float looseness = grid.getCellSize() / 2.0f;
+        grid.query(grid.getCellX(area.left - looseness),  grid.getCellY(area.top - looseness),
+                   grid.getCellX(area.right + looseness), grid.getCellY(area.bottom + looseness), area, result);
+    }
+}
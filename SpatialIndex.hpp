@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+
+#include "BlockBounds.hpp"
+#include "BlockGrid.hpp"
+
+/*
+    Loose multi-level grid.
+
+    Level N has cells of cellSize * 2^N. A block goes to the finest level
+    where its bounds stay inside its center cell grown by half a cell on
+    every side, so a query only needs to look half a cell further than the
+    area asked. The last level covers the whole map and is always scanned.
+    Query results are tested against the real rotated bounds of each block.
+
+    Items are the slot indices of BlockPool.
+ */
+
+class SpatialIndex
+{
+public:
+    void create(int width, int height, int cellSize);
+    void clear();
+
+    // bounds[N] is the bounds of item N, empty bounds skips the item.
+    void build(const std::vector<BlockBounds>& bounds);
+
+    void insert(uint32_t item, const BlockBounds& bounds);
+    // Many items at once, bounds[N] is for items[N].
+    void insert(const std::vector<uint32_t>& items, const std::vector<BlockBounds>& bounds);
+    void remove(uint32_t item);
+    // New bounds for items that moved, bounds[N] is for items[N]. Only items
+    // whose center left their cell go to another cell, they are all taken
+    // out first so cells do not run out of slack on the way.
+    void update(const std::vector<uint32_t>& items, const std::vector<BlockBounds>& bounds);
+
+    // Appends all items whose bounds intersect area.
+    void query(const BlockBounds& area, std::vector<uint32_t>& result);
+
+    const BlockBounds& getBounds(uint32_t item) const { return itemBounds[item]; }
+    int getCellSize() const { return cellSize; }
+
+private:
+    int getLevelFor(const BlockBounds& bounds) const;
+    void rebuildLevel(int level);
+
+    std::vector <BlockGrid> levels;
+    std::vector <BlockBounds> itemBounds;   // Empty when the item is not in the index
+    std::vector <uint8_t> itemLevel;
+    std::vector <uint32_t> movedItems;      // Reused by update
+
+    int cellSize = 1;
+};
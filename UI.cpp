@@ -206,10 +206,12 @@ void BlockSelectList::draw(class Resources *res, sf::RenderWindow& window, bool
     {
         sf::Sprite textureSprite = {};
         
-        sf::Texture *texture = textures[c].texture;
-        if(!texture)
+        if(!textures[c].texture)
             break;
 
+        // Asked again every frame, the texture may have been evicted since.
+        sf::Texture *texture = res->getTexture(textures[c].ID);
+
         float xScale = blockWidthInView/texture->getSize().x;
         float yScale = blockHeightInView/texture->getSize().y;
 
@@ -19,6 +19,9 @@ const float toolAreaWidth  = 0.9f;
 const float blockRotateSpeed = 200.0f;
 const float cameraMoveSpeed = 5000.0f;
 const float zoomSpeed = 10.0f;
+const float lassoPointDistance = 8.0f;  // Pixels between the points of a lasso
+const float selectionMoveStep = 8.0f;   // Arrow keys move the selection this much
+const float selectionTurn = 90.0f;      // R turns the selection this much, shift turns it back
 
 const std::string defaultFilename       = "DefaultMapName";
 const std::string defaultAuthor         = "DefaultAuthor";
@@ -29,6 +32,11 @@ float getMin(float v1, float v2)
     return v1<v2?v1:v2;
 }
 
+float getMax(float v1, float v2)
+{
+    return v1>v2?v1:v2;
+}
+
 void init(sf::RectangleShape& viewOutlines, sf::IntRect& viewArea, UI& ui, sf::View& camera, class Resources *res)
 {
     viewOutlines.setFillColor(sf::Color::Transparent);
@@ -82,6 +90,8 @@ int main( int argc, char **argv )
    
     sf::View camera;
     sf::Sprite selectedBlockSprite;
+    std::vector <sf::Vector2f> dragPoints;  // Selection box corner or lasso being dragged
+    bool lassoDrag = false;
     sf::Text text;
 
     myResources.setWindowWidth(screenW);
@@ -187,10 +197,35 @@ int main( int argc, char **argv )
 
                     case sf::Keyboard::Key::Delete:
                     {
-                        if ( myMap.getSelectedBlock() != nullptr )
-                        {
-                            myMap.removeBlock(myMap.getSelectedBlock());
-                        }
+                        if ( !myConsole.isActive() )
+                            myMap.deleteSelection();
+                    }
+                    break;
+
+                    // Keys typed to the console don't move the selection.
+                    case sf::Keyboard::Key::Left:   if ( !myConsole.isActive() ) myMap.moveSelection(-selectionMoveStep, 0.0f); break;
+                    case sf::Keyboard::Key::Right:  if ( !myConsole.isActive() ) myMap.moveSelection(selectionMoveStep, 0.0f);  break;
+                    case sf::Keyboard::Key::Up:     if ( !myConsole.isActive() ) myMap.moveSelection(0.0f, -selectionMoveStep); break;
+                    case sf::Keyboard::Key::Down:   if ( !myConsole.isActive() ) myMap.moveSelection(0.0f, selectionMoveStep);  break;
+
+                    case sf::Keyboard::Key::C:
+                    {
+                        if ( event.key.control && !myConsole.isActive() )
+                            myMap.copySelection();
+                    }
+                    break;
+
+                    case sf::Keyboard::Key::V:
+                    {
+                        if ( event.key.control && !myConsole.isActive() && inRect(mousePos, viewArea) )
+                            myMap.paste(mousePosMap.x, mousePosMap.y);
+                    }
+                    break;
+
+                    case sf::Keyboard::Key::R:
+                    {
+                        if ( !myConsole.isActive() )
+                            myMap.rotateSelection(event.key.shift ? -selectionTurn : selectionTurn);
                     }
                     break;
 
@@ -344,9 +379,39 @@ int main( int argc, char **argv )
     else
         release = true;
 
+    // Right click selects a block, dragged with shift a box and with control a lasso.
+    // With alt the blocks are added to the selection.
     if ( sf::Mouse::isButtonPressed(sf::Mouse::Button::Right) )
     {
-        myMap.selectBlockUnderMouse(mousePosMap, camera);
+        if ( dragPoints.empty() && inRect(mousePos, viewArea) &&
+             (sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) || sf::Keyboard::isKeyPressed(sf::Keyboard::LControl)) )
+        {
+            lassoDrag = sf::Keyboard::isKeyPressed(sf::Keyboard::LControl);
+            dragPoints.push_back(mousePosMap);
+        }
+
+        if ( dragPoints.empty() )
+            myMap.selectBlockUnderMouse(mousePosMap, camera);
+        else if ( lassoDrag )
+        {
+            sf::Vector2f delta = mousePosMap - dragPoints.back();
+            float distance = lassoPointDistance * camera.getSize().x / (float)screenW;
+
+            if ( delta.x*delta.x + delta.y*delta.y >= distance*distance )
+                dragPoints.push_back(mousePosMap);
+        }
+    }
+    else if ( !dragPoints.empty() )
+    {
+        bool add = sf::Keyboard::isKeyPressed(sf::Keyboard::LAlt);
+
+        if ( lassoDrag )
+            myMap.selectLasso(dragPoints, add);
+        else
+            myMap.selectArea({getMin(dragPoints[0].x, mousePosMap.x), getMin(dragPoints[0].y, mousePosMap.y),
+                              getMax(dragPoints[0].x, mousePosMap.x), getMax(dragPoints[0].y, mousePosMap.y)}, add);
+
+        dragPoints.clear();
     }
     
 
@@ -356,9 +421,36 @@ int main( int argc, char **argv )
     
     myUI.update();
     myConsole.update(deltaTime);
+    myMap.update(camera);
 
 /*********************************** DRAW ************************************/
     myMap.draw(window, camera);
+
+    if ( !dragPoints.empty() )
+    {
+        sf::VertexArray outline(sf::LineStrip);
+        sf::Vector2f first = dragPoints[0];
+
+        if ( lassoDrag )
+        {
+            for ( const auto& point : dragPoints )
+                outline.append(sf::Vertex(point, sf::Color::Yellow));
+            outline.append(sf::Vertex(mousePosMap, sf::Color::Yellow));
+        }
+        else
+        {
+            outline.append(sf::Vertex(first, sf::Color::Yellow));
+            outline.append(sf::Vertex({mousePosMap.x, first.y}, sf::Color::Yellow));
+            outline.append(sf::Vertex(mousePosMap, sf::Color::Yellow));
+            outline.append(sf::Vertex({first.x, mousePosMap.y}, sf::Color::Yellow));
+        }
+        outline.append(sf::Vertex(first, sf::Color::Yellow));
+
+        window.setView(camera);
+        window.draw(outline);
+        window.setView(window.getDefaultView());
+    }
+
     window.draw(viewOutlines);
 
     myUI.draw(&myResources, window);
@@ -367,6 +459,10 @@ int main( int argc, char **argv )
     if ( inRect(mousePos, viewArea) )
     {
 
+        // Block textures can be evicted, so the texture is asked every frame.
+        if ( sf::Texture *texture = myResources.getTexture(myUI.getSelectedBlock()) )
+            selectedBlockSprite.setTexture(*texture);
+
         selectedBlockSprite.setOrigin(selectedBlockSprite.getLocalBounds().width/2.0f, selectedBlockSprite.getLocalBounds().height/2.0f);
         selectedBlockSprite.setColor(sf::Color(255, 255, 255, 128));
         sf::Vector2f pos = window.mapPixelToCoords(mousePos, camera);
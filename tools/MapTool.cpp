@@ -0,0 +1,561 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "MapData.hpp"
+#include "MapFormat.hpp"
+#include "BlockOrder.hpp"
+#include "AtomicWrite.hpp"
+#include "CompactBlocks.hpp"
+
+#ifdef linux
+#include <filesystem>
+namespace fs = std::filesystem;
+#endif
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <experimental/filesystem>
+namespace fs = std::experimental::filesystem;
+#endif
+
+/*
+    Batch tool for map files, no window needed.
+
+    mapTool convert  [options] files...     Writes the files in the v2 format
+    mapTool validate [options] files...     Checks headers, chunk directories and blocks
+    mapTool stats    [options] files...     Prints size, blocks, chunks and ids
+    mapTool crop     [options] -a x y w h files...
+                                            Keeps the blocks centered in the area
+    mapTool merge    [options] -o out files...
+                                            Puts the blocks of all files to one map
+
+    Options
+        -o path     Output directory (convert, crop) or file (merge).
+                    Without it convert and crop replace the input files.
+        -c size     Chunk size of the written files, default 500.
+        -j count    Files processed at the same time, default all cores.
+
+    Every file is read from a memory mapped view and written with one
+    atomic write. Files are spread over the worker threads, the results
+    are printed in the order of the arguments.
+ */
+
+struct Options
+{
+    std::string command;
+    std::vector <std::string> files;
+    std::string output;
+    int chunkSize = defaultGridSize;
+    unsigned int threads = 0;
+    bool hasArea = false;
+    BlockBounds area;
+};
+
+// Result of one file, printed after all files are done.
+struct FileResult
+{
+    bool ok = true;
+    std::string text;
+};
+
+static void printUsage()
+{
+    std::cout << "Usage: mapTool convert|validate|stats|crop|merge [-o path] [-c chunk size] [-j threads] "
+                 "[-a x y width height] files..." << std::endl;
+}
+
+static bool parseOptions(int argc, char **argv, Options& options)
+{
+    if ( argc < 3 )
+        return false;
+
+    options.command = argv[1];
+
+    for ( int c = 2; c < argc; c++ )
+    {
+        std::string arg = argv[c];
+
+        if ( arg == "-o" && c+1 < argc )
+            options.output = argv[++c];
+        else if ( arg == "-c" && c+1 < argc )
+            options.chunkSize = std::atoi(argv[++c]);
+        else if ( arg == "-j" && c+1 < argc )
+            options.threads = std::atoi(argv[++c]);
+        else if ( arg == "-a" && c+4 < argc )
+        {
+            float x      = std::atof(argv[++c]);
+            float y      = std::atof(argv[++c]);
+            float width  = std::atof(argv[++c]);
+            float height = std::atof(argv[++c]);
+
+            options.area = {x, y, x + width, y + height};
+            options.hasArea = width > 0.0f && height > 0.0f;
+        }
+        else if ( !arg.empty() && arg[0] == '-' )
+        {
+            std::cout << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        else
+            options.files.push_back(arg);
+    }
+
+    return !options.files.empty() && options.chunkSize > 0;
+}
+
+// Where convert and crop write file.
+static std::string getOutputName(const Options& options, const std::string& file)
+{
+    if ( options.output.empty() )
+        return file;
+
+    return (fs::path(options.output) / fs::path(file).filename()).string();
+}
+
+// Small sizes in bytes, so they are not all rounded to 0 or 1 KB.
+static std::string formatSize(size_t bytes)
+{
+    if ( bytes < 10 * 1024 )
+        return std::to_string(bytes) + " bytes";
+
+    return std::to_string(bytes / 1024) + " KB";
+}
+
+static Block readBlock(const MapReader& reader, unsigned int index)
+{
+    // Block data in the file may be unaligned.
+    Block block;
+    std::memcpy(&block, reader.getBlockData() + (size_t)index * sizeof(Block), sizeof(Block));
+    return block;
+}
+
+// Blocks of all readers by chunk of a layout. The blocks stay in the mapped
+// files, only their index is kept, so memory is 4 bytes a block instead of
+// the whole map.
+struct ChunkedBlocks
+{
+    std::vector <unsigned int> firstBlock;      // Index of the first block of every reader
+    std::vector <unsigned int> chunkStart;      // First of chunkBlocks of every chunk, one extra at the end
+    std::vector <unsigned int> chunkBlocks;     // Blocks over all readers by chunk
+    std::vector <BlockBounds> chunkBounds;      // Of the block centers
+
+    void create(const std::vector<MapReader>& readers, const GridLayout& layout)
+    {
+        unsigned int blockCount = 0;
+        firstBlock.clear();
+        for ( const auto& reader : readers )
+        {
+            firstBlock.push_back(blockCount);
+            blockCount += reader.getBlockCount();
+        }
+
+        // Counts and bounds of the chunks first, then the blocks by chunk.
+        chunkStart.assign(layout.getCellCount() + 1, 0);
+        chunkBounds.assign(layout.getCellCount(), BlockBounds());
+
+        for ( const auto& reader : readers )
+            for ( unsigned int c = 0; c < reader.getBlockCount(); c++ )
+            {
+                Block block = readBlock(reader, c);
+                int chunk = layout.getCell(block.x, block.y);
+
+                chunkStart[chunk + 1]++;
+                chunkBounds[chunk].add({block.x, block.y, block.x, block.y});
+            }
+
+        for ( unsigned int c = 1; c < chunkStart.size(); c++ )
+            chunkStart[c] += chunkStart[c - 1];
+
+        chunkBlocks.resize(blockCount);
+        std::vector <unsigned int> next(chunkStart.begin(), chunkStart.end() - 1);
+
+        for ( unsigned int r = 0; r < readers.size(); r++ )
+            for ( unsigned int c = 0; c < readers[r].getBlockCount(); c++ )
+            {
+                Block block = readBlock(readers[r], c);
+                chunkBlocks[next[layout.getCell(block.x, block.y)]++] = firstBlock[r] + c;
+            }
+    }
+
+    unsigned int getBlockCount(int chunk) const { return chunkStart[chunk + 1] - chunkStart[chunk]; }
+
+    void read(const std::vector<MapReader>& readers, int chunk, std::vector<Block>& result) const
+    {
+        for ( unsigned int c = chunkStart[chunk]; c < chunkStart[chunk + 1]; c++ )
+        {
+            unsigned int r = std::upper_bound(firstBlock.begin(), firstBlock.end(), chunkBlocks[c]) - firstBlock.begin() - 1;
+            result.push_back(readBlock(readers[r], chunkBlocks[c] - firstBlock[r]));
+        }
+    }
+};
+
+/*
+    Writes the blocks of all readers to one v2 file, one output chunk at a
+    time. The input chunks are not used as they are: a v1 file is one chunk
+    and -c can change the chunk size, either way one input chunk goes to many
+    output chunks. Readers are closed before the commit, so the output can be
+    an input file.
+ */
+static bool writeChunked(const std::string& filename, const MapFile& info, std::vector<MapReader>& readers,
+                         int chunkSize, bool keepBackup)
+{
+    BlockOrder blockOrder;
+    blockOrder.create(info.width, info.height, chunkSize);
+    const GridLayout& layout = blockOrder.layout;
+
+    ChunkedBlocks chunked;
+    chunked.create(readers, layout);
+
+    std::vector <MapChunkEntry> directory;
+    for ( int chunk = 0; chunk < layout.getCellCount(); chunk++ )
+        if ( chunked.getBlockCount(chunk) > 0 )
+            directory.push_back({chunk, (int)chunked.getBlockCount(chunk), 0, chunked.chunkBounds[chunk]});
+
+    std::vector <char> header = writeMapV2Header(info, layout, directory);
+
+    AtomicFileWriter writer;
+    if ( !writer.open(filename) || !writer.write(header.data(), header.size()) )
+        return false;
+
+    std::vector <Block> buffer;
+    for ( const auto& entry : directory )
+    {
+        buffer.clear();
+        chunked.read(readers, entry.chunk, buffer);
+        sortBlocks(blockOrder, buffer);
+
+        if ( !writer.write(buffer.data(), buffer.size() * sizeof(Block)) )
+            return false;
+    }
+
+    for ( auto& reader : readers )
+        reader.close();
+
+    return writer.commit(keepBackup);
+}
+
+static bool writeMap(const std::string& filename, const MapFile& info, const std::vector<Block>& blocks,
+                     int chunkSize, bool keepBackup)
+{
+    std::vector <char> buffer = writeMapV2(info, blocks.data(), blocks.size(), chunkSize);
+    return writeFileAtomic(filename, buffer.data(), buffer.size(), keepBackup);
+}
+
+static FileResult convertFile(const Options& options, const std::string& file)
+{
+    FileResult result;
+    std::vector <MapReader> readers(1);
+
+    if ( !readers[0].open(file) )
+        return {false, "can't read the map"};
+
+    int version = readers[0].getVersion();
+    unsigned int blockCount = readers[0].getBlockCount();
+    MapFile info = readers[0].getInfo();
+
+    std::string output = getOutputName(options, file);
+    if ( !writeChunked(output, info, readers, options.chunkSize, output == file) )
+        return {false, "can't write " + output};
+
+    result.text = "v" + std::to_string(version) + " -> v2, " + std::to_string(blockCount) + " blocks to " + output;
+    return result;
+}
+
+static FileResult validateFile(const Options&, const std::string& file)
+{
+    FileResult result;
+    std::vector <MapReader> readers(1);
+    MapReader& reader = readers[0];
+
+    // Header, block count and chunk directory are checked when opened.
+    if ( !reader.open(file) )
+        return {false, "header or chunk directory does not match the file"};
+
+    const MapFile& info = reader.getInfo();
+    std::vector <std::string> problems;
+    BlockProblems found;
+    std::vector <Block> chunkBlocks;
+
+    // One chunk at a time, the file is never copied as a whole.
+    if ( reader.getVersion() == 2 )
+    {
+        // Blocks have to be in the chunk the directory says.
+        GridLayout layout;
+        layout.create(info.width, info.height, reader.getChunkSize());
+
+        unsigned int misplaced = 0;
+        for ( unsigned int c = 0; c < reader.getChunks().size(); c++ )
+        {
+            chunkBlocks.clear();
+            reader.readChunk(c, chunkBlocks);
+            found.check(info, chunkBlocks.data(), chunkBlocks.size());
+
+            for ( const Block& block : chunkBlocks )
+                if ( layout.getCell(block.x, block.y) != reader.getChunks()[c].chunk )
+                    misplaced++;
+        }
+
+        if ( misplaced > 0 )
+            problems.push_back(std::to_string(misplaced) + " blocks are in the wrong chunk.");
+    }
+    else
+    {
+        // v1 files are one chunk, the blocks are put to chunks by their index.
+        GridLayout layout;
+        layout.create(info.width, info.height, defaultGridSize);
+
+        ChunkedBlocks chunked;
+        chunked.create(readers, layout);
+
+        for ( int chunk = 0; chunk < layout.getCellCount(); chunk++ )
+        {
+            chunkBlocks.clear();
+            chunked.read(readers, chunk, chunkBlocks);
+            found.check(info, chunkBlocks.data(), chunkBlocks.size());
+        }
+    }
+
+    found.report(info, problems);
+
+    result.ok = problems.empty();
+    result.text = result.ok ? "ok, " + std::to_string(reader.getBlockCount()) + " blocks" : "";
+    for ( const auto& problem : problems )
+        result.text += (result.text.empty() ? "" : "\n    ") + problem;
+
+    return result;
+}
+
+static FileResult statsFile(const Options&, const std::string& file)
+{
+    FileResult result;
+    MapReader reader;
+
+    if ( !reader.open(file) )
+        return {false, "can't read the map"};
+
+    const MapFile& info = reader.getInfo();
+
+    // One chunk at a time, the file is never copied as a whole.
+    std::map <int, unsigned int> idCounts;
+    BlockBounds extent;
+    std::vector <Block> chunkBlocks;
+    for ( unsigned int c = 0; c < reader.getChunks().size(); c++ )
+    {
+        chunkBlocks.clear();
+        reader.readChunk(c, chunkBlocks);
+
+        for ( const Block& block : chunkBlocks )
+        {
+            idCounts[block.id]++;
+            extent.add({block.x, block.y, block.x, block.y});
+        }
+    }
+
+    result.text  = "v" + std::to_string(reader.getVersion()) + " '" + info.name + "' by '" + info.author + "', ";
+    result.text += std::to_string(info.width) + "x" + std::to_string(info.height) + ", ";
+    result.text += std::to_string(reader.getBlockCount()) + " blocks, " + std::to_string(idCounts.size()) + " block ids";
+
+    if ( reader.getVersion() == 2 )
+        result.text += ", " + std::to_string(reader.getChunks().size()) + " chunks of " + std::to_string(reader.getChunkSize());
+
+    if ( !extent.isEmpty() )
+        result.text += "\n    blocks from " + std::to_string((int)extent.left) + "," + std::to_string((int)extent.top) +
+                       " to " + std::to_string((int)extent.right) + "," + std::to_string((int)extent.bottom);
+
+    // Most used ids first.
+    std::vector <std::pair<unsigned int, int>> topIds;
+    for ( const auto& idCount : idCounts )
+        topIds.push_back({idCount.second, idCount.first});
+    std::sort(topIds.rbegin(), topIds.rend());
+
+    if ( !topIds.empty() )
+    {
+        result.text += "\n    most used ids:";
+        for ( unsigned int c = 0; c < topIds.size() && c < 5; c++ )
+            result.text += " " + std::to_string(topIds[c].second) + " (" + std::to_string(topIds[c].first) + ")";
+    }
+
+    CompactBlocks compact;
+    compact.load(reader, reader.getChunkSize() > 0 ? reader.getChunkSize() : defaultGridSize);
+    result.text += "\n    " + formatSize(reader.getBlockCount() * sizeof(Block)) + " as blocks, " +
+                   formatSize(compact.getMemoryUsage()) + " compact (load with view), " +
+                   std::to_string(compact.getExactCount()) + " blocks kept exact";
+
+    return result;
+}
+
+static FileResult cropFile(const Options& options, const std::string& file)
+{
+    MapReader reader;
+    if ( !reader.open(file) )
+        return {false, "can't read the map"};
+
+    // Only the chunks that touch the area are read from v2 files.
+    std::vector <int> entries;
+    reader.findChunks(options.area, entries);
+
+    std::vector <Block> chunkBlocks;
+    std::vector <Block> blocks;
+    for ( int entry : entries )
+    {
+        chunkBlocks.clear();
+        reader.readChunk(entry, chunkBlocks);
+
+        for ( Block block : chunkBlocks )
+        {
+            if ( !options.area.contains(block.x, block.y) )
+                continue;
+
+            block.x -= options.area.left;
+            block.y -= options.area.top;
+            blocks.push_back(block);
+        }
+    }
+
+    MapFile info = reader.getInfo();
+    info.width  = std::ceil(options.area.right - options.area.left);
+    info.height = std::ceil(options.area.bottom - options.area.top);
+    reader.close();
+
+    std::string output = getOutputName(options, file);
+    if ( !writeMap(output, info, blocks, options.chunkSize, output == file) )
+        return {false, "can't write " + output};
+
+    return {true, std::to_string(blocks.size()) + " blocks to " + output};
+}
+
+// Runs operation for every file on the worker threads.
+template <class Operation>
+static std::vector<FileResult> forEachFile(const Options& options, Operation operation)
+{
+    std::vector <FileResult> results(options.files.size());
+    std::atomic <unsigned int> nextFile{0};
+
+    unsigned int threadCount = options.threads > 0 ? options.threads : std::thread::hardware_concurrency();
+    threadCount = std::max(1u, std::min<unsigned int>(threadCount, options.files.size()));
+
+    std::vector <std::thread> workers;
+    for ( unsigned int t = 0; t < threadCount; t++ )
+    {
+        workers.emplace_back([&]() {
+            for ( unsigned int c = nextFile++; c < options.files.size(); c = nextFile++ )
+                results[c] = operation(options, options.files[c]);
+        });
+    }
+
+    for ( auto& worker : workers )
+        worker.join();
+
+    return results;
+}
+
+static int merge(const Options& options)
+{
+    if ( options.output.empty() )
+    {
+        std::cout << "merge needs the output file (-o)" << std::endl;
+        return 1;
+    }
+
+    // Files are opened in parallel, the blocks are put together in the argument order.
+    std::vector <MapReader> readers(options.files.size());
+
+    std::vector <FileResult> results = forEachFile(options, [&](const Options&, const std::string& file) -> FileResult {
+        MapReader& reader = readers[&file - &options.files[0]];
+
+        if ( !reader.open(file) )
+            return {false, "can't read the map"};
+
+        return {true, std::to_string(reader.getBlockCount()) + " blocks"};
+    });
+
+    MapFile info = {0, 0, "", ""};
+    unsigned int blockCount = 0;
+    bool ok = true;
+
+    for ( unsigned int c = 0; c < options.files.size(); c++ )
+    {
+        std::cout << options.files[c] << ": " << results[c].text << std::endl;
+        if ( !results[c].ok )
+        {
+            ok = false;
+            continue;
+        }
+
+        const MapFile& fileInfo = readers[c].getInfo();
+        if ( info.name.empty() )
+        {
+            info.name = fileInfo.name;
+            info.author = fileInfo.author;
+        }
+        info.width  = std::max(info.width, fileInfo.width);
+        info.height = std::max(info.height, fileInfo.height);
+
+        blockCount += readers[c].getBlockCount();
+    }
+
+    if ( !ok )
+        return 1;
+
+    if ( !writeChunked(options.output, info, readers, options.chunkSize, false) )
+    {
+        std::cout << "Can't write " << options.output << std::endl;
+        return 1;
+    }
+
+    std::cout << blockCount << " blocks to " << options.output << std::endl;
+    return 0;
+}
+
+int main( int argc, char **argv )
+{
+    Options options;
+
+    if ( !parseOptions(argc, argv, options) )
+    {
+        printUsage();
+        return 1;
+    }
+
+    if ( options.command == "merge" )
+        return merge(options);
+
+    std::vector <FileResult> results;
+
+    if ( options.command == "convert" )
+        results = forEachFile(options, convertFile);
+    else if ( options.command == "validate" )
+        results = forEachFile(options, validateFile);
+    else if ( options.command == "stats" )
+        results = forEachFile(options, statsFile);
+    else if ( options.command == "crop" )
+    {
+        if ( !options.hasArea )
+        {
+            std::cout << "crop needs the area (-a x y width height)" << std::endl;
+            return 1;
+        }
+        results = forEachFile(options, cropFile);
+    }
+    else
+    {
+        printUsage();
+        return 1;
+    }
+
+    int failed = 0;
+    for ( unsigned int c = 0; c < results.size(); c++ )
+    {
+        std::cout << options.files[c] << ": " << results[c].text << std::endl;
+        if ( !results[c].ok )
+            failed++;
+    }
+
+    return failed > 0 ? 1 : 0;
+}